@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// The VMs the days actually run, each in its own namespace since they all define a `CPU`, a
+// `Tape` and the same enums. Everything they include is included above, so the headers
+// don't get pulled into the namespaces too.
+//
+// None of them counts instructions, so each workload is given the count from the same
+// workload on the benchmark CPU (cpu.hpp), computed once outside of the timed runs.
+
+namespace day9 {
+#include "../day9/cpu.hpp"
+}
+
+namespace day19 {
+#include "../day19/cpu.hpp"
+}
+
+namespace day23 {
+#include "../day23/cpu.hpp"
+#include "../day23/compact_cpu.hpp"
+}
+
+namespace day25 {
+#include "../day25/cpu.hpp"
+}
+
+template <typename T>
+T convert_tape(const Tape& tape) {
+    return T(tape.begin(), tape.end());
+}
+
+// Day 9: BOOST in sensor boost mode on the handler table CPU
+run_t day9_boost_workload(const day9::Tape& tape, uint64_t instructions) {
+    auto in = std::make_shared<std::istringstream>("2");
+    auto out = std::make_shared<std::ostringstream>();
+    auto cpu = std::make_shared<day9::CPU>(tape, *in, *out);
+    return [in, out, cpu, instructions]() {
+        cpu->run_program();
+        return instructions;
+    };
+}
+
+// Day 19: the part 1 scan of the 50x50 area, one run of the pooled CPU per point
+run_t day19_scan_workload(const day19::Tape& tape, uint64_t instructions) {
+    auto pool = std::make_shared<day19::CPUPool>(tape);
+    pool->acquire();
+    return [pool, instructions]() {
+        for (int y = 0; y < 50; y++) {
+            for (int x = 0; x < 50; x++) {
+                auto& pooled = pool->acquire();
+                pooled.out << x << std::endl << y << std::endl;
+                pooled.cpu.run_until(day19::STOP_ON_OUTPUT);
+
+                int in_beam;
+                pooled.in >> in_beam;
+            }
+        }
+        return instructions;
+    };
+}
+
+// Instructions of the day 19 scan: every point runs from the start up to its output
+uint64_t beam_scan_instructions(const Tape& tape) {
+    uint64_t instructions = 0;
+    for (int y = 0; y < 50; y++) {
+        for (int x = 0; x < 50; x++) {
+            CPU cpu(tape);
+            cpu.get_in().push(x);
+            cpu.get_in().push(y);
+            while (cpu.get_out().empty() && cpu.run_one_instruction() == InstrExecStatus::ALL_GOOD);
+            instructions += cpu.get_instructions_executed();
+        }
+    }
+    return instructions;
+}
+
+// Day 23: the same network as `network_workload` on the compact CPUs. Packets are fed one
+// at a time since a compact CPU only buffers one
+run_t day23_compact_workload(const day23::Tape& tape, uint64_t instructions) {
+    const int n_cpus = 50;
+
+    auto image = std::make_shared<day23::Image>(tape);
+    auto cpus = std::make_shared<std::vector<day23::CompactCPU>>();
+    for (int i = 0; i < n_cpus; i++) {
+        cpus->emplace_back(*image);
+        cpus->back().push_input(i);
+    }
+
+    return [image, cpus, n_cpus, instructions]() {
+        std::vector<std::queue<long long int>> mailbox(n_cpus);
+        long long int nat_x = -1, nat_y = -1, last_from_nat_y = -2;
+        std::vector<long long int> sent;
+
+        // Runs `cpu` until it waits for input, collecting the packets it sends
+        auto run = [&sent](day23::CompactCPU& cpu) {
+            while (true) {
+                auto status = cpu.run();
+                if (cpu.n_outputs() == day23::CompactCPU::out_capacity) {
+                    for (uint8_t i = 0; i < cpu.n_outputs(); i++) sent.push_back(cpu.output(i));
+                    cpu.clear_outputs();
+                }
+                if (status != day23::InstrExecStatus::OUTPUT_FULL) return;
+            }
+        };
+
+        // Each NIC reads its address and then polls for packets, so booting all of them
+        // first runs the same instructions as giving each one both values in its first turn
+        for (auto& cpu : *cpus) run(cpu);
+
+        while (true) {
+            bool idle = true;
+            for (int i = 0; i < n_cpus; i++) {
+                auto& cpu = (*cpus)[i];
+
+                if (mailbox[i].empty()) {
+                    cpu.push_input(-1);
+                    run(cpu);
+                }
+                while (!mailbox[i].empty()) {
+                    cpu.push_input(mailbox[i].front()); mailbox[i].pop();
+                    cpu.push_input(mailbox[i].front()); mailbox[i].pop();
+                    run(cpu);
+                }
+
+                for (size_t j = 0; j + 3 <= sent.size(); j += 3) {
+                    if (sent[j] == 255) {
+                        nat_x = sent[j + 1];
+                        nat_y = sent[j + 2];
+                    } else {
+                        mailbox[sent[j]].push(sent[j + 1]);
+                        mailbox[sent[j]].push(sent[j + 2]);
+                        idle = false;
+                    }
+                }
+                sent.clear();
+            }
+
+            if (idle && nat_y != -1) {
+                if (nat_y == last_from_nat_y) break;
+                last_from_nat_y = nat_y;
+                mailbox[0].push(nat_x);
+                mailbox[0].push(nat_y);
+            }
+        }
+        return instructions;
+    };
+}
+
+// Day 25: the same walk as `checkpoint_workload` on the CPU with the state hash
+run_t day25_checkpoint_workload(const day25::Tape& tape, const std::vector<std::string>& lines,
+                                uint64_t instructions) {
+    auto cpu = std::make_shared<day25::CPU>(tape);
+    for (const auto& line : lines) cpu->write_ascii(line + "\n");
+    return [cpu, instructions]() {
+        cpu->run_until_more_input_is_required();
+        return instructions;
+    };
+}
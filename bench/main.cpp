@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "cpu.hpp"
+
+// Counts every heap allocation made by the process. Only the allocations made while a
+// workload is being timed are reported
+static uint64_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// A workload is prepared outside of the timed region. Preparing it returns the function
+// that is actually timed, which returns the number of Intcode instructions it executed
+using run_t = std::function<uint64_t()>;
+
+struct Workload {
+    std::string name;
+    std::function<run_t()> prepare;
+};
+
+struct Sample {
+    double ns;
+    uint64_t instructions;
+    uint64_t allocations;
+};
+
+struct Summary {
+    std::string name;
+    uint64_t instructions;
+    double min_ns, p50_ns, p90_ns, p99_ns;
+    double mad_ns;
+    uint64_t allocations;
+
+    // Based on the fastest run: noise from the rest of the machine only ever makes a run
+    // slower, so the minimum is the most repeatable statistic between invocations
+    double ns_per_instruction() const { return min_ns / instructions; }
+};
+
+void push_line(CPU& cpu, const std::string& line) {
+    for (auto c : line) cpu.get_in().push(c);
+    cpu.get_in().push('\n');
+}
+
+// Day 9: BOOST program in sensor boost mode (input 2)
+run_t boost_workload(const Tape& tape) {
+    auto cpu = std::make_shared<CPU>(tape);
+    cpu->get_in().push(2);
+    return [cpu]() {
+        cpu->run_program();
+        return cpu->get_instructions_executed();
+    };
+}
+
+// Day 23: 50 NICs exchanging packets until the NAT delivers the same y value twice in a row
+run_t network_workload(const Tape& tape) {
+    const int n_cpus = 50;
+
+    auto cpus = std::make_shared<std::vector<CPU>>();
+    for (int i = 0; i < n_cpus; i++) {
+        CPU cpu(tape);
+        cpu.get_in().push(i);
+        cpus->push_back(cpu);
+    }
+
+    return [cpus, n_cpus]() {
+        std::vector<std::queue<long long int>> mailbox(n_cpus);
+        long long int nat_x = -1, nat_y = -1, last_from_nat_y = -2;
+
+        while (true) {
+            bool idle = true;
+            for (int i = 0; i < n_cpus; i++) {
+                auto& cpu = (*cpus)[i];
+
+                if (mailbox[i].empty()) cpu.get_in().push(-1);
+                while (!mailbox[i].empty()) {
+                    cpu.get_in().push(mailbox[i].front());
+                    mailbox[i].pop();
+                }
+                cpu.run_until_more_input_is_required();
+
+                auto& out = cpu.get_out();
+                while (out.size() >= 3) {
+                    auto to = out.front(); out.pop();
+                    auto x = out.front(); out.pop();
+                    auto y = out.front(); out.pop();
+                    if (to == 255) {
+                        nat_x = x;
+                        nat_y = y;
+                    } else {
+                        mailbox[to].push(x);
+                        mailbox[to].push(y);
+                        idle = false;
+                    }
+                }
+            }
+
+            if (idle && nat_y != -1) {
+                if (nat_y == last_from_nat_y) break;
+                last_from_nat_y = nat_y;
+                mailbox[0].push(nat_x);
+                mailbox[0].push(nat_y);
+            }
+        }
+
+        uint64_t instructions = 0;
+        for (const auto& cpu : *cpus) instructions += cpu.get_instructions_executed();
+        return instructions;
+    };
+}
+
+// Day 25: the commands that pick up the safe items and walk to the security checkpoint
+std::vector<std::string> checkpoint_commands() {
+    const std::vector<std::pair<std::string,std::vector<std::string>>> items{
+        {"bowl of rice", {"east", "north", "west"}},
+        {"fuel cell", {"east", "north", "north", "west", "south", "south"}},
+        {"ornament", {"east", "north", "north", "west"}},
+        {"planetoid", {"east", "north", "north"}},
+        {"cake", {"east", "north", "north", "east"}},
+        {"astrolabe", {"east", "north", "north", "east", "south", "west", "north"}},
+        {"shell", {"east", "east", "east"}},
+        {"monolith", {"east", "east", "south"}},
+    };
+    const std::vector<std::string> checkpoint_path{
+        "east", "north", "north", "east", "south", "west", "north", "west"
+    };
+    const std::map<std::string,std::string> back{
+        {"north", "south"}, {"south", "north"}, {"east", "west"}, {"west", "east"}
+    };
+
+    std::vector<std::string> commands;
+    for (const auto& item : items) {
+        commands.insert(commands.end(), item.second.begin(), item.second.end());
+        commands.push_back("take " + item.first);
+        for (auto it = item.second.rbegin(); it != item.second.rend(); it++) commands.push_back(back.at(*it));
+    }
+    commands.insert(commands.end(), checkpoint_path.begin(), checkpoint_path.end());
+    return commands;
+}
+
+run_t checkpoint_workload(const Tape& tape) {
+    auto cpu = std::make_shared<CPU>(tape);
+    for (const auto& command : checkpoint_commands()) push_line(*cpu, command);
+
+    return [cpu]() {
+        cpu->run_until_more_input_is_required();
+        return cpu->get_instructions_executed();
+    };
+}
+
+// Synthetic: position mode countdown loop
+//   0: ADD $100 -1 $100
+//   4: JIT $100 0
+//   7: HLT
+run_t countdown_workload(long long int n) {
+    Tape tape;
+    const std::vector<long long int> code{1001, 100, -1, 100, 1005, 100, 0, 99};
+    for (size_t i = 0; i < code.size(); i++) tape[i] = code[i];
+    tape[100] = n;
+
+    auto cpu = std::make_shared<CPU>(tape);
+    return [cpu]() {
+        cpu->run_program();
+        return cpu->get_instructions_executed();
+    };
+}
+
+// Synthetic: relative mode summation loop, outputs n * (n + 1) / 2
+//   0: SRO 100
+//   2: ADD REL(1) REL(0) REL(1)
+//   6: ADD REL(0) -1 REL(0)
+//  10: JIT REL(0) 2
+//  13: OUT REL(1)
+//  15: HLT
+run_t summation_workload(long long int n) {
+    Tape tape;
+    const std::vector<long long int> code{
+        109, 100, 22201, 1, 0, 1, 21201, 0, -1, 0, 1205, 0, 2, 204, 1, 99
+    };
+    for (size_t i = 0; i < code.size(); i++) tape[i] = code[i];
+    tape[100] = n;
+    tape[101] = 0;
+
+    auto cpu = std::make_shared<CPU>(tape);
+    return [cpu]() {
+        cpu->run_program();
+        return cpu->get_instructions_executed();
+    };
+}
+
+#include "days.hpp"
+
+double percentile(const std::vector<double>& sorted, double p) {
+    auto idx = static_cast<size_t>(std::ceil(p * sorted.size())) - 1;
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+Summary run_workload(const Workload& workload, int warmup, int runs) {
+    for (int i = 0; i < warmup; i++) workload.prepare()();
+
+    std::vector<Sample> samples;
+    for (int i = 0; i < runs; i++) {
+        auto run = workload.prepare();
+
+        auto allocations_before = allocations;
+        auto start = std::chrono::steady_clock::now();
+        auto instructions = run();
+        auto end = std::chrono::steady_clock::now();
+
+        samples.push_back({
+            std::chrono::duration<double, std::nano>(end - start).count(),
+            instructions,
+            allocations - allocations_before
+        });
+    }
+
+    std::vector<double> ns;
+    for (const auto& s : samples) ns.push_back(s.ns);
+    std::sort(ns.begin(), ns.end());
+
+    auto median = percentile(ns, 0.5);
+    std::vector<double> deviations;
+    for (auto x : ns) deviations.push_back(std::abs(x - median));
+    std::sort(deviations.begin(), deviations.end());
+
+    return Summary{
+        workload.name,
+        samples.front().instructions,
+        ns.front(), median, percentile(ns, 0.9), percentile(ns, 0.99),
+        percentile(deviations, 0.5),
+        samples.front().allocations
+    };
+}
+
+void print_summaries(const std::vector<Summary>& summaries) {
+    std::cout << std::left << std::setw(14) << "workload" << std::right
+              << std::setw(12) << "instrs"
+              << std::setw(10) << "min ms"
+              << std::setw(10) << "p50 ms"
+              << std::setw(10) << "p90 ms"
+              << std::setw(10) << "p99 ms"
+              << std::setw(8) << "MAD%"
+              << std::setw(10) << "Minstr/s"
+              << std::setw(10) << "ns/instr"
+              << std::setw(10) << "allocs" << std::endl;
+
+    for (const auto& s : summaries) {
+        std::cout << std::left << std::setw(14) << s.name << std::right << std::fixed
+                  << std::setw(12) << s.instructions
+                  << std::setprecision(3)
+                  << std::setw(10) << s.min_ns / 1e6
+                  << std::setw(10) << s.p50_ns / 1e6
+                  << std::setw(10) << s.p90_ns / 1e6
+                  << std::setw(10) << s.p99_ns / 1e6
+                  << std::setprecision(2)
+                  << std::setw(8) << 100 * s.mad_ns / s.p50_ns
+                  << std::setw(10) << s.instructions / s.p50_ns * 1e3
+                  << std::setw(10) << s.ns_per_instruction()
+                  << std::setw(10) << s.allocations << std::endl;
+    }
+}
+
+void save_baseline(const std::string& filename, const std::vector<Summary>& summaries) {
+    std::ofstream file(filename);
+    for (const auto& s : summaries) {
+        file << s.name << " " << std::setprecision(17) << s.ns_per_instruction() << std::endl;
+    }
+}
+
+// Returns false if any workload got slower than the baseline by more than `threshold`
+bool compare_to_baseline(const std::string& filename, const std::vector<Summary>& summaries, double threshold) {
+    std::map<std::string,double> baseline;
+    std::ifstream file(filename);
+    std::string name;
+    double ns;
+    while (file >> name >> ns) baseline[name] = ns;
+
+    bool ok = true;
+    for (const auto& s : summaries) {
+        if (baseline.count(s.name) == 0) continue;
+        auto change = s.ns_per_instruction() / baseline[s.name] - 1;
+        bool regressed = change > threshold;
+        ok = ok && !regressed;
+        std::cout << std::left << std::setw(14) << s.name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(8) << 100 * change << "%"
+                  << (regressed ? "  REGRESSION" : "") << std::endl;
+    }
+    return ok;
+}
+
+void pin_to_one_core() {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(sched_getcpu(), &set);
+    sched_setaffinity(0, sizeof(set), &set);
+#endif
+}
+
+int main(int argc, char** argv) {
+    int runs = 30;
+    int warmup = 3;
+    std::string save_to, compare_to;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--runs" && i + 1 < argc) runs = std::stoi(argv[++i]);
+        else if (arg == "--warmup" && i + 1 < argc) warmup = std::stoi(argv[++i]);
+        else if (arg == "--save" && i + 1 < argc) save_to = argv[++i];
+        else if (arg == "--compare" && i + 1 < argc) compare_to = argv[++i];
+        else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--runs N] [--warmup N] [--save FILE] [--compare FILE]" << std::endl;
+            return 2;
+        }
+    }
+
+    pin_to_one_core();
+
+    const auto boost = read_tape_from_disk("../day9/input.txt");
+    const auto nic = read_tape_from_disk("../day23/input.txt");
+    const auto adventure = read_tape_from_disk("../day25/input.txt");
+    const auto beam = read_tape_from_disk("../day19/input.txt");
+
+    // The same workloads on the VMs of the days themselves
+    const auto day9_boost = convert_tape<day9::Tape>(boost);
+    const auto day19_beam = convert_tape<day19::Tape>(beam);
+    const auto boost_instructions = boost_workload(boost)();
+    const auto beam_instructions = beam_scan_instructions(beam);
+    const auto network_instructions = network_workload(nic)();
+    const auto checkpoint_instructions = checkpoint_workload(adventure)();
+
+    const std::vector<Workload> workloads{
+        {"day9-boost", [&boost]() { return boost_workload(boost); }},
+        {"day23-network", [&nic]() { return network_workload(nic); }},
+        {"day25-checkpt", [&adventure]() { return checkpoint_workload(adventure); }},
+        {"countdown", []() { return countdown_workload(1000000); }},
+        {"summation", []() { return summation_workload(1000000); }},
+        {"day9-vm", [&]() { return day9_boost_workload(day9_boost, boost_instructions); }},
+        {"day19-vm", [&]() { return day19_scan_workload(day19_beam, beam_instructions); }},
+        {"day23-compact", [&]() { return day23_compact_workload(nic, network_instructions); }},
+        {"day25-vm", [&]() { return day25_checkpoint_workload(adventure, checkpoint_commands(), checkpoint_instructions); }},
+    };
+
+    std::vector<Summary> summaries;
+    for (const auto& workload : workloads) {
+        summaries.push_back(run_workload(workload, warmup, runs));
+    }
+
+    print_summaries(summaries);
+
+    if (!save_to.empty()) save_baseline(save_to, summaries);
+
+    // The fastest of 30 runs on a pinned core is typically within 1% between invocations,
+    // so a 3% slowdown of the core loop stands out
+    if (!compare_to.empty() && !compare_to_baseline(compare_to, summaries, 0.03)) return 1;
+}
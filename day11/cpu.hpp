@@ -1,14 +1,26 @@
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <queue>
 #include <unordered_map>
 
 
-using Tape = std::unordered_map<size_t,long int>;
+using Tape = std::unordered_map<size_t,long long int>;
 
 enum class InstrExecStatus {
-    IDLE, ALL_GOOD, HALT, UNKOWN_OPCODE
+    IDLE, ALL_GOOD, HALT, UNKOWN_OPCODE, NO_INPUT, OUTPUT, OUT_OF_BUDGET,
+};
+
+// Events `CPU::run_until` stops on, besides the program halting. Combine them with |
+enum StopMask : unsigned {
+    // Before an INPUT instruction, if there is no input to read
+    STOP_ON_INPUT  = 1 << 0,
+
+    // After the nth OUTPUT instruction
+    STOP_ON_OUTPUT = 1 << 1,
 };
 
 enum class OpCodes {
@@ -32,27 +44,60 @@ enum class AddressingModes {
 
 class CPU {
 public:
-    CPU(const Tape& tape, std::istream& in, std::ostream& out):
+    CPU(const Tape& tape):
         tape(tape),
         pc(0),
-        relative_addr_base(0),
-        in(in),
-        out(out) {}
+        relative_addr_base(0) {}
 
     InstrExecStatus run_program() {
-        InstrExecStatus status;
-        while((status = run_one_instruction()) == InstrExecStatus::ALL_GOOD);
-        return status;
+        return run_until(0);
+    }
+
+    // Runs until the program halts, stops on one of the `stop` events, or `budget`
+    // instructions ran. Each instruction word is fetched once, and events are only checked
+    // for the INPUT and OUTPUT instructions
+    InstrExecStatus run_until(unsigned stop, uint64_t n = 1,
+                              uint64_t budget = std::numeric_limits<uint64_t>::max()) {
+        uint64_t outputs = 0;
+        for (; budget > 0; budget--) {
+            auto instr = tape[pc];
+            auto opcode = instr % 100;
+            if (opcode == static_cast<int>(OpCodes::INPUT) && (stop & STOP_ON_INPUT) && !has_pending_input()) {
+                return InstrExecStatus::NO_INPUT;
+            }
+
+            auto status = execute(opcode, instr / 100);
+            if (status != InstrExecStatus::ALL_GOOD) return status;
+            if (opcode == static_cast<int>(OpCodes::OUTPUT) && (stop & STOP_ON_OUTPUT) && ++outputs == n) {
+                return InstrExecStatus::OUTPUT;
+            }
+        }
+        return InstrExecStatus::OUT_OF_BUDGET;
+    }
+
+    InstrExecStatus run_one_instruction() {
+        auto instr = tape[pc];
+        return execute(instr % 100, instr / 100);
+    }
+
+    bool has_pending_input() const {
+        return !in.empty();
     }
 
     int peek_current_opcode() {
         return tape[pc];
     }
 
-    InstrExecStatus run_one_instruction() {
-        auto opcode = tape[pc] % 100;
-        auto modes  = tape[pc] / 100;
+    std::queue<long long int>& get_in() { return in; }
+    std::queue<long long int>& get_out() { return out; }
 
+    void mem_dump(size_t start, size_t end) {
+        for (int i = start; i < end; i++) {
+            std::cout << i << ": " << tape[i] << std::endl;
+        }
+    }
+private:
+    InstrExecStatus execute(long long int opcode, long long int modes) {
         switch (static_cast<OpCodes>(opcode)) {
             case OpCodes::ADD: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
@@ -67,16 +112,15 @@ public:
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::INPUT: {
-                int n;
                 auto addrs = eval_operand_addrs(1, modes, pc + 1);
-                in >> n;
-                tape[addrs[0]] = n;
+                tape[addrs[0]] = in.front();
+                in.pop();
                 pc += 2;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::OUTPUT: {
                 auto addrs = eval_operand_addrs(1, modes, pc + 1);
-                out << tape[addrs[0]] << std::endl;
+                out.push(tape[addrs[0]]);
                 pc += 2;
                 return InstrExecStatus::ALL_GOOD;
             }
@@ -113,12 +157,6 @@ public:
         }
     }
 
-    void mem_dump(size_t start, size_t end) {
-        for (int i = start; i < end; i++) {
-            std::cout << i << ": " << tape[i] << std::endl;
-        }
-    }
-private:
     Tape tape;
 
     // Program counter
@@ -127,8 +165,8 @@ private:
     // Base pointer for relative addressing
     size_t relative_addr_base;
 
-    std::istream &in;
-    std::ostream &out;
+    std::queue<long long int> in;
+    std::queue<long long int> out;
 
     int eval_operand_addr(int mode, size_t position) {
         switch (static_cast<AddressingModes>(mode)) {
@@ -149,7 +187,7 @@ private:
 
 Tape read_tape_from_disk(std::string filename) {
     Tape tape;
-    std::ifstream file(filename, 0);
+    std::ifstream file(filename);
 
     size_t head_pos = 0;
     std::string val;
@@ -1,33 +1,16 @@
 #include <algorithm>
 #include <fstream>
 #include <iostream>
-#include <sstream>
-#include <map>
+#include <vector>
 
 #include "cpu.hpp"
 
 using coord_t = std::pair<int,int>;
-using grid_t = std::map<coord_t,int>;
 
 enum class Direction {
     UP, RIGHT, DOWN, LEFT
 };
 
-InstrExecStatus run_until_output_is_produced_or_halt(CPU &cpu) {
-    while(cpu.peek_current_opcode() % 100 != 4) {
-        if(cpu.run_one_instruction() == InstrExecStatus::HALT)
-            return InstrExecStatus::HALT;
-    }
-    // Execute the output instruction we just found
-    return cpu.run_one_instruction();
-}
-
-InstrExecStatus run_for_two_outputs(CPU &cpu) {
-    if (run_until_output_is_produced_or_halt(cpu) == InstrExecStatus::HALT)
-        return InstrExecStatus::HALT;
-    return run_until_output_is_produced_or_halt(cpu);
-}
-
 void update_robot_pos(coord_t& robot_pos, Direction direction) {
     switch (direction) {
         case Direction::UP:    { robot_pos.second--; return; }
@@ -45,39 +28,110 @@ Direction update_robot_direction(Direction current_direction, int turn) {
     }
 }
 
-void print_grid(const grid_t& grid, int size) {
-    for (int y = -size/2; y <= size/2; y++) {
-        for (int x = -size/2; x <= size/2; x++) {
-            if (grid.count({x, y}) == 0 || grid.at({x, y}) == 0) std::cout << ".";
-            else std::cout << "#";
+// Dense grid of hull panels. It covers [min_x, min_x + width) x [min_y, min_y + height)
+// and grows on whichever side the robot walks off, so coordinates can go negative. Each
+// growth at least doubles the grid along that axis, so walking n panels in a straight line
+// takes O(log n) growths. Panels that were painted at least once are tracked in a separate bitmap
+class Hull {
+public:
+    static const int chunk = 64;
+
+    Hull(): min_x(-chunk / 2), min_y(-chunk / 2), width(chunk), height(chunk),
+            colors(width * height, 0), painted(width * height, false), n_painted(0) {}
+
+    int get(coord_t pos) {
+        return colors[index(pos)];
+    }
+
+    void paint(coord_t pos, int color) {
+        auto i = index(pos);
+        colors[i] = color;
+        if (!painted[i]) {
+            painted[i] = true;
+            n_painted++;
+        }
+    }
+
+    size_t painted_count() const { return n_painted; }
+
+    // Prints the smallest rectangle containing every painted panel
+    void print() const {
+        int x_lo = width, x_hi = -1, y_lo = height, y_hi = -1;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                if (!painted[y * width + x]) continue;
+                x_lo = std::min(x_lo, x); x_hi = std::max(x_hi, x);
+                y_lo = std::min(y_lo, y); y_hi = std::max(y_hi, y);
+            }
+        }
+
+        for (int y = y_lo; y <= y_hi; y++) {
+            for (int x = x_lo; x <= x_hi; x++) std::cout << (colors[y * width + x] ? "#" : ".");
+            std::cout << std::endl;
         }
         std::cout << std::endl;
     }
-    std::cout << std::endl;
-}
 
-void run_robot(grid_t& grid, const Tape& tape) {
-    std::stringbuf buf;
-    std::istream in(&buf);
-    std::ostream out(&buf);
+private:
+    int min_x, min_y, width, height;
+    std::vector<char> colors;
+    std::vector<bool> painted;
+    size_t n_painted;
+
+    size_t index(coord_t pos) {
+        if (pos.first < min_x || pos.first >= min_x + width || pos.second < min_y || pos.second >= min_y + height)
+            grow_to_fit(pos);
+        return (pos.second - min_y) * width + (pos.first - min_x);
+    }
+
+    void grow_to_fit(coord_t pos) {
+        int grow_x = std::max(chunk, width), grow_y = std::max(chunk, height);
+        int left   = pos.first < min_x ? grow_x : 0;
+        int right  = pos.first >= min_x + width ? grow_x : 0;
+        int top    = pos.second < min_y ? grow_y : 0;
+        int bottom = pos.second >= min_y + height ? grow_y : 0;
+
+        int new_width = width + left + right, new_height = height + top + bottom;
+        std::vector<char> new_colors(new_width * new_height, 0);
+        std::vector<bool> new_painted(new_width * new_height, false);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                auto i = (y + top) * new_width + x + left;
+                new_colors[i] = colors[y * width + x];
+                new_painted[i] = painted[y * width + x];
+            }
+        }
+
+        min_x -= left;
+        min_y -= top;
+        width = new_width;
+        height = new_height;
+        colors.swap(new_colors);
+        painted.swap(new_painted);
+
+        // The robot only moves one panel at a time, but just in case
+        index(pos);
+    }
+};
 
-    CPU cpu(tape, in, out);
+void run_robot(Hull& hull, const Tape& tape) {
+    CPU cpu(tape);
 
     coord_t robot_pos = {0, 0};
     Direction robot_direction = Direction::UP;
 
-    int color;
-    int turn;
-
     for (auto status = InstrExecStatus::IDLE; status != InstrExecStatus::HALT; ) {
-        out << grid[robot_pos] << std::endl;
+        cpu.get_in().push(hull.get(robot_pos));
 
-        status = run_for_two_outputs(cpu);
+        status = cpu.run_until(STOP_ON_OUTPUT, 2);
+        if (cpu.get_out().size() < 2) break;
 
-        in >> color;
-        in >> turn;
+        int color = cpu.get_out().front();
+        cpu.get_out().pop();
+        int turn = cpu.get_out().front();
+        cpu.get_out().pop();
 
-        grid[robot_pos] = color;
+        hull.paint(robot_pos, color);
 
         robot_direction = update_robot_direction(robot_direction, turn);
         update_robot_pos(robot_pos, robot_direction);
@@ -85,21 +139,22 @@ void run_robot(grid_t& grid, const Tape& tape) {
 }
 
 void part1(const Tape& tape) {
-    grid_t grid;
+    Hull hull;
 
-    run_robot(grid, tape);
+    run_robot(hull, tape);
 
-    std::cout << "Part 1: " << grid.size() << std::endl;
+    std::cout << "Part 1: " << hull.painted_count() << std::endl;
 }
 
 void part2(const Tape& tape) {
-    // Initialize grid with position (0,0) set to 1
-    grid_t grid{{{0,0}, 1}};
+    // Start on a white panel
+    Hull hull;
+    hull.paint({0, 0}, 1);
 
-    run_robot(grid, tape);
+    run_robot(hull, tape);
 
     std::cout << "Part 2: " << std::endl;
-    print_grid(grid, 100);
+    hull.print();
 }
 
 int main() {
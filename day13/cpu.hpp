@@ -1,14 +1,28 @@
+#include <cstdint>
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <sstream>
 #include <vector>
+#include <queue>
 #include <unordered_map>
 
 
-using Tape = std::unordered_map<size_t,long int>;
+using Tape = std::unordered_map<size_t,long long int>;
 
 enum class InstrExecStatus {
-    IDLE, ALL_GOOD, HALT, UNKOWN_OPCODE
+    IDLE, ALL_GOOD, HALT, UNKOWN_OPCODE, NO_INPUT, OUTPUT, OUT_OF_BUDGET,
+};
+
+// Events `CPU::run_until` stops on, besides the program halting. Combine them with |
+enum StopMask : unsigned {
+    // Before an INPUT instruction, if there is no input to read
+    STOP_ON_INPUT  = 1 << 0,
+
+    // After the nth OUTPUT instruction
+    STOP_ON_OUTPUT = 1 << 1,
 };
 
 enum class OpCodes {
@@ -30,53 +44,135 @@ enum class AddressingModes {
     RELATIVE  = 2,
 };
 
+// Read-only window over `size` cells of a tape starting at `begin`, with every cell
+// converted to T
+template <typename T>
+class MemoryView {
+public:
+    MemoryView(const Tape& tape, size_t begin, size_t size): tape(tape), begin(begin), n(size) {}
+
+    T operator[](size_t i) const {
+        auto it = tape.find(begin + i);
+        return static_cast<T>(it == tape.end() ? 0 : it->second);
+    }
+
+    size_t size() const { return n; }
+
+private:
+    const Tape& tape;
+    size_t begin;
+    size_t n;
+};
+
+// Called with (address, old value, new value) on every write to a watched address
+using watch_callback_t = std::function<void(size_t,long long int,long long int)>;
+
+struct Watch {
+    size_t begin, end;
+    watch_callback_t callback;
+};
+
 class CPU {
 public:
-    CPU(const Tape& tape, std::istream& in, std::ostream& out):
+    CPU(const Tape& tape):
         tape(tape),
         pc(0),
         relative_addr_base(0),
-        in(in),
-        out(out) {}
+        watched_begin(0),
+        watched_size(0) {}
+
+    // Calls `callback` after every write to an address in [begin, end). Stores outside of
+    // the range spanned by all watches cost a single comparison, and without any watches
+    // that comparison always fails
+    void watch(size_t begin, size_t end, watch_callback_t callback) {
+        watches.push_back({begin, end, callback});
+
+        size_t lo = std::numeric_limits<size_t>::max(), hi = 0;
+        for (const auto& w : watches) {
+            lo = std::min(lo, w.begin);
+            hi = std::max(hi, w.end);
+        }
+        watched_begin = lo;
+        watched_size = hi > lo ? hi - lo : 0;
+    }
+
+    template <typename T = long long int>
+    MemoryView<T> view(size_t begin, size_t end) const {
+        return MemoryView<T>(tape, begin, end - begin);
+    }
 
     InstrExecStatus run_program() {
-        InstrExecStatus status;
-        while((status = run_one_instruction()) == InstrExecStatus::ALL_GOOD);
-        return status;
+        return run_until(0);
+    }
+
+    // Runs until the program halts, stops on one of the `stop` events, or `budget`
+    // instructions ran. Each instruction word is fetched once, and events are only checked
+    // for the INPUT and OUTPUT instructions
+    InstrExecStatus run_until(unsigned stop, uint64_t n = 1,
+                              uint64_t budget = std::numeric_limits<uint64_t>::max()) {
+        uint64_t outputs = 0;
+        for (; budget > 0; budget--) {
+            auto instr = tape[pc];
+            auto opcode = instr % 100;
+            if (opcode == static_cast<int>(OpCodes::INPUT) && (stop & STOP_ON_INPUT) && !has_pending_input()) {
+                return InstrExecStatus::NO_INPUT;
+            }
+
+            auto status = execute(opcode, instr / 100);
+            if (status != InstrExecStatus::ALL_GOOD) return status;
+            if (opcode == static_cast<int>(OpCodes::OUTPUT) && (stop & STOP_ON_OUTPUT) && ++outputs == n) {
+                return InstrExecStatus::OUTPUT;
+            }
+        }
+        return InstrExecStatus::OUT_OF_BUDGET;
+    }
+
+    InstrExecStatus run_one_instruction() {
+        auto instr = tape[pc];
+        return execute(instr % 100, instr / 100);
+    }
+
+    bool has_pending_input() const {
+        return !in.empty();
     }
 
     int peek_current_opcode() {
         return tape[pc];
     }
 
-    InstrExecStatus run_one_instruction() {
-        auto opcode = tape[pc] % 100;
-        auto modes  = tape[pc] / 100;
+    std::queue<long long int>& get_in() { return in; }
+    std::queue<long long int>& get_out() { return out; }
 
+    void mem_dump(size_t start, size_t end) {
+        for (int i = start; i < end; i++) {
+            std::cout << i << ": " << tape[i] << std::endl;
+        }
+    }
+private:
+    InstrExecStatus execute(long long int opcode, long long int modes) {
         switch (static_cast<OpCodes>(opcode)) {
             case OpCodes::ADD: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] + tape[addrs[1]];
+                store(addrs[2], tape[addrs[0]] + tape[addrs[1]]);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::MULT: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] * tape[addrs[1]];
+                store(addrs[2], tape[addrs[0]] * tape[addrs[1]]);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::INPUT: {
-                int n;
                 auto addrs = eval_operand_addrs(1, modes, pc + 1);
-                in >> n;
-                tape[addrs[0]] = n;
+                store(addrs[0], in.front());
+                in.pop();
                 pc += 2;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::OUTPUT: {
                 auto addrs = eval_operand_addrs(1, modes, pc + 1);
-                out << tape[addrs[0]] << std::endl;
+                out.push(tape[addrs[0]]);
                 pc += 2;
                 return InstrExecStatus::ALL_GOOD;
             }
@@ -92,13 +188,13 @@ public:
             }
             case OpCodes::LESS_THAN: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] < tape[addrs[1]] ? 1 : 0;
+                store(addrs[2], tape[addrs[0]] < tape[addrs[1]] ? 1 : 0);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::EQUALS: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] == tape[addrs[1]] ? 1 : 0;
+                store(addrs[2], tape[addrs[0]] == tape[addrs[1]] ? 1 : 0);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
@@ -113,12 +209,6 @@ public:
         }
     }
 
-    void mem_dump(size_t start, size_t end) {
-        for (int i = start; i < end; i++) {
-            std::cout << i << ": " << tape[i] << std::endl;
-        }
-    }
-private:
     Tape tape;
 
     // Program counter
@@ -127,8 +217,26 @@ private:
     // Base pointer for relative addressing
     size_t relative_addr_base;
 
-    std::istream &in;
-    std::ostream &out;
+    std::queue<long long int> in;
+    std::queue<long long int> out;
+
+    // Smallest range covering every watch, as [watched_begin, watched_begin + watched_size)
+    size_t watched_begin;
+    size_t watched_size;
+    std::vector<Watch> watches;
+
+    void store(size_t addr, long long int value) {
+        auto& cell = tape[addr];
+        auto old = cell;
+        cell = value;
+
+        // Also false for addresses below `watched_begin`, which wrap around
+        if (addr - watched_begin < watched_size) {
+            for (const auto& w : watches) {
+                if (addr >= w.begin && addr < w.end) w.callback(addr, old, value);
+            }
+        }
+    }
 
     int eval_operand_addr(int mode, size_t position) {
         switch (static_cast<AddressingModes>(mode)) {
@@ -149,7 +257,7 @@ private:
 
 Tape read_tape_from_disk(std::string filename) {
     Tape tape;
-    std::ifstream file(filename, 0);
+    std::ifstream file(filename);
 
     size_t head_pos = 0;
     std::string val;
@@ -1,8 +1,8 @@
 #include <algorithm>
+#include <chrono>
 #include <iostream>
-#include <sstream>
-#include <map>
-#include <numeric>
+#include <string>
+#include <vector>
 
 #include "cpu.hpp"
 
@@ -12,28 +12,6 @@ enum class GameObj {
 };
 
 using coord_t = std::pair<int,int>;
-using grid_t = std::map<coord_t,GameObj>;
-
-grid_t to_grid(grid_t& grid, std::istream& in) {
-    int x, y, obj;
-    while (in) {
-        in >> x;
-        in >> y;
-        in >> obj;
-
-        if (x == -1) std::cout << "SCORE: " << obj << std::endl;
-        else grid[{x,y}] = static_cast<GameObj>(obj);
-    }
-    return grid;
-}
-
-int count_blocks(const grid_t& grid) {
-    return std::count_if(
-        grid.begin(),
-        grid.end(),
-        [](std::pair<coord_t,GameObj>kv) { return kv.second == GameObj::BLOCK; }
-    );
-}
 
 char to_char(GameObj obj) {
     switch (obj) {
@@ -45,114 +23,213 @@ char to_char(GameObj obj) {
         default: return '?';
     }
 }
-void draw_grid(const grid_t& grid) {
-    for(int y = 0; y < 30; y++) {
-        for(int x = 0; x < 60; x++) {
-            if (grid.count({x, y}) > 0) std::cout << to_char(grid.at({x, y}));
-            else std::cout << "+";
+
+// Dense framebuffer of the arcade screen. The number of blocks, the ball and paddle
+// positions and the score are kept up to date as tiles are drawn, so none of them need
+// a scan of the screen
+class Screen {
+public:
+    Screen(): width(0), height(0), blocks(0), ball(-1, -1), paddle(-1, -1), score(0) {}
+
+    // Applies one (x, y, tile id) triple output by the game
+    void draw(long long int x, long long int y, long long int value) {
+        if (x == -1 && y == 0) {
+            score = value;
+            return;
         }
-        std::cout << std::endl;
+
+        auto obj = static_cast<GameObj>(value);
+        auto& cell = at(x, y);
+        if (cell == GameObj::BLOCK) blocks--;
+        if (obj == GameObj::BLOCK) blocks++;
+        if (obj == GameObj::BALL) ball = {x, y};
+        if (obj == GameObj::H_PADDLE) paddle = {x, y};
+        cell = obj;
     }
-}
 
-InstrExecStatus run_until_input_is_required(CPU &cpu) {
-    InstrExecStatus status;
-    while(cpu.peek_current_opcode() % 100 != static_cast<int>(OpCodes::INPUT)) {
-        status = cpu.run_one_instruction();
-        if (status == InstrExecStatus::HALT) return status;
+    void draw_all(std::queue<long long int>& out) {
+        while (out.size() >= 3) {
+            auto x = out.front(); out.pop();
+            auto y = out.front(); out.pop();
+            auto value = out.front(); out.pop();
+            draw(x, y, value);
+        }
     }
-    return status;
-}
 
-coord_t get_pos(const grid_t& grid, GameObj obj) {
-    return std::find_if(
-        grid.begin(),
-        grid.end(),
-        [obj](const std::pair<coord_t, GameObj>& kv) { return kv.second == obj; }
-    )->first;
-}
+    void render(std::ostream& out) const {
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) out << to_char(cells[y * width + x]);
+            out << std::endl;
+        }
+        out << "Score: " << score << ", blocks left: " << blocks << std::endl;
+    }
 
-bool exists(const grid_t& grid, GameObj obj) {
-    return std::count_if(
-        grid.begin(),
-        grid.end(),
-        [obj](const std::pair<coord_t, GameObj>& kv) { return kv.second == obj; }
-    ) > 0;
-}
+    int get_blocks() const { return blocks; }
+    coord_t get_ball() const { return ball; }
+    coord_t get_paddle() const { return paddle; }
+    long long int get_score() const { return score; }
+
+private:
+    int width, height;
+    std::vector<GameObj> cells;
+
+    int blocks;
+    coord_t ball;
+    coord_t paddle;
+    long long int score;
+
+    GameObj& at(int x, int y) {
+        if (x >= width || y >= height) {
+            int new_width = std::max(width, x + 1), new_height = std::max(height, y + 1);
+            std::vector<GameObj> grown(new_width * new_height, GameObj::EMPTY);
+            for (int row = 0; row < height; row++) {
+                std::copy(cells.begin() + row * width, cells.begin() + (row + 1) * width, grown.begin() + row * new_width);
+            }
+            width = new_width;
+            height = new_height;
+            cells.swap(grown);
+        }
+        return cells[y * width + x];
+    }
+};
 
 int sign(int n) {
     return n == 0 ? 0 : n / std::abs(n);
 }
 
-void part1(const Tape& tape_in, std::istream& in, std::ostream& out) {
-    grid_t grid;
-    Tape tape = tape_in;
-    auto cpu = CPU(tape, in, out);
+void part1(const Tape& tape) {
+    Screen screen;
+    auto cpu = CPU(tape);
     cpu.run_program();
-    to_grid(grid, in);
-    std::cout << "Part 1: " << count_blocks(grid) << std::endl;
+    screen.draw_all(cpu.get_out());
+    std::cout << "Part 1: " << screen.get_blocks() << std::endl;
 }
 
-void part2(const Tape& tape_in, std::istream& in, std::ostream& out) {
-    grid_t grid;
-
+// Plays the game to the end, moving the paddle towards the ball. The screen is only rendered
+// if `render_every` is non-zero, and then at most once per `render_every`
+void part2(const Tape& tape_in, std::chrono::milliseconds render_every) {
     Tape tape = tape_in;
 
     // Insert coin
     tape[0] = 2;
 
-    auto cpu = CPU(tape, in, out);
-    run_until_input_is_required(cpu);
-    to_grid(grid, in);
+    Screen screen;
+    auto cpu = CPU(tape);
+    auto last_render = std::chrono::steady_clock::now() - render_every;
 
-    auto last_ball_pos = get_pos(grid, GameObj::BALL);
-    while (count_blocks(grid) > 0) {
-        auto ball_pos = get_pos(grid, GameObj::BALL);
-        auto paddle_pos = get_pos(grid, GameObj::H_PADDLE);
-        grid[ball_pos] = GameObj::EMPTY;
-        grid[paddle_pos] = GameObj::EMPTY;
+    while (true) {
+        auto status = cpu.run_until(STOP_ON_INPUT);
+        screen.draw_all(cpu.get_out());
 
-        coord_t ball_vel = {ball_pos.first - last_ball_pos.first, ball_pos.second - last_ball_pos.second};
-        last_ball_pos = ball_pos;
-
-        int ball_height = -(ball_pos.second - paddle_pos.second);
-        int prediction_x = ball_pos.first + ball_vel.first * ball_height;
+        if (render_every.count() > 0) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_render >= render_every || status == InstrExecStatus::HALT) {
+                screen.render(std::cout);
+                last_render = now;
+            }
+        }
 
-        std::cout << "Ball: " << ball_pos.first << ", " << ball_pos.second << std::endl;
-        std::cout << "Ball vel: " << ball_vel.first << ", " << ball_vel.second << std::endl;
-        std::cout << "Paddle: " << paddle_pos.first << ", " << paddle_pos.second << std::endl;
-        std::cout << "Prediction: " << prediction_x << std::endl;
+        if (status == InstrExecStatus::HALT) break;
 
         // Write joystick input
-        out << sign(prediction_x - paddle_pos.first) << std::endl;
+        cpu.get_in().push(sign(screen.get_ball().first - screen.get_paddle().first));
+    }
 
-        // Step over the INPUT instruction
-        cpu.run_one_instruction();
+    std::cout << "Part 2: " << screen.get_score() << std::endl;
+}
 
-        run_until_input_is_required(cpu);
+// Addresses of the game's own ball and paddle x coordinates, found by watching which cells
+// keep holding the same values as the screen says for the first few frames
+struct GameLayout {
+    size_t ball_x;
+    size_t paddle_x;
+};
 
-        to_grid(grid, in);
+bool find_layout(const Tape& tape, GameLayout& layout) {
+    Screen screen;
+    auto cpu = CPU(tape);
+    auto memory = cpu.view(0, tape.size());
 
-        if (!exists(grid, GameObj::BALL)) grid[ball_pos] = GameObj::BALL;
-        if (!exists(grid, GameObj::H_PADDLE)) grid[paddle_pos] = GameObj::H_PADDLE;
+    std::vector<size_t> ball_candidates, paddle_candidates;
+    for (size_t addr = 0; addr < memory.size(); addr++) {
+        ball_candidates.push_back(addr);
+        paddle_candidates.push_back(addr);
+    }
 
-        in.clear();
+    auto keep_if_equal = [&memory](std::vector<size_t>& candidates, long long int value) {
+        candidates.erase(
+            std::remove_if(
+                candidates.begin(),
+                candidates.end(),
+                [&memory, value](size_t addr) { return memory[addr] != value; }
+            ),
+            candidates.end()
+        );
+    };
+
+    for (int frame = 0; frame < 100; frame++) {
+        if (cpu.run_until(STOP_ON_INPUT) == InstrExecStatus::HALT) return false;
+        screen.draw_all(cpu.get_out());
+
+        keep_if_equal(ball_candidates, screen.get_ball().first);
+        keep_if_equal(paddle_candidates, screen.get_paddle().first);
+        if (ball_candidates.size() == 1 && paddle_candidates.size() == 1) {
+            layout = {ball_candidates[0], paddle_candidates[0]};
+            return true;
+        }
 
-        draw_grid(grid);
+        // Keep the paddle moving so its coordinate doesn't get mixed up with constants
+        cpu.get_in().push(frame % 20 < 10 ? -1 : 1);
     }
+    return false;
 }
 
-int main() {
-    std::stringbuf out_buf;
-    std::istream in(&out_buf);
-    std::ostream out(&out_buf);
+// Same game as part 2, but the bot never looks at the screen: it follows the ball and
+// paddle through watchpoints on their addresses. The screen output is thrown away, except
+// for the score at the very end
+long long int play_from_memory(const Tape& tape, const GameLayout& layout) {
+    auto cpu = CPU(tape);
+
+    // Start from whatever is in the image, the watches take it from there
+    long long int ball_x = cpu.view(layout.ball_x, layout.ball_x + 1)[0];
+    long long int paddle_x = cpu.view(layout.paddle_x, layout.paddle_x + 1)[0];
+    cpu.watch(layout.ball_x, layout.ball_x + 1, [&ball_x](size_t, long long int, long long int x) { ball_x = x; });
+    cpu.watch(layout.paddle_x, layout.paddle_x + 1, [&paddle_x](size_t, long long int, long long int x) { paddle_x = x; });
+
+    long long int score = 0;
+    while (true) {
+        auto status = cpu.run_until(STOP_ON_INPUT);
+
+        auto& out = cpu.get_out();
+        while (out.size() >= 3) {
+            auto x = out.front(); out.pop();
+            auto y = out.front(); out.pop();
+            if (x == -1 && y == 0) score = out.front();
+            out.pop();
+        }
+
+        if (status == InstrExecStatus::HALT) return score;
+        cpu.get_in().push(sign(ball_x - paddle_x));
+    }
+}
 
+int main(int argc, char** argv) {
     auto tape = read_tape_from_disk("input.txt");
 
-    part1(tape, in, out);
+    // Pass --render to watch the game, at most 30 frames per second
+    bool render = argc > 1 && std::string(argv[1]) == "--render";
+
+    part1(tape);
+    part2(tape, std::chrono::milliseconds(render ? 33 : 0));
 
-    // Reset istream's EOF bit
-    in.clear();
+    Tape with_coin = tape;
+    with_coin[0] = 2;
 
-    part2(tape, in, out);
-}
\ No newline at end of file
+    GameLayout layout;
+    if (find_layout(with_coin, layout)) {
+        std::cout << "Ball x at " << layout.ball_x << ", paddle x at " << layout.paddle_x << std::endl;
+        std::cout << "Part 2 (memory bot): " << play_from_memory(with_coin, layout) << std::endl;
+    } else {
+        std::cout << "Could not find the ball and paddle in memory" << std::endl;
+    }
+}
@@ -1,41 +1,72 @@
+#include <algorithm>
 #include <iostream>
 #include <queue>
-#include <set>
 #include <sstream>
 #include <vector>
-#include <map>
 
 #include "cpu.hpp"
 
 using coord_t = std::pair<int,int>;
-using path_t = std::vector<int>;
 const std::vector<int> moves = {1, 2, 3, 4};
 
-InstrExecStatus run_until_output_is_produced(CPU &cpu) {
-    InstrExecStatus status;
-    while(cpu.peek_current_opcode() % 100 != static_cast<int>(OpCodes::OUTPUT)) {
-        status = cpu.run_one_instruction();
-        if (status == InstrExecStatus::HALT) return status;
+enum class Cell : char {
+    UNKNOWN, WALL, OPEN, OXYGEN,
+};
+
+// Dense grid of cells that grows (doubling in each direction) to fit whatever coordinate
+// is written to it, so negative coordinates are fine
+class Grid {
+public:
+    Grid(): min_x(-8), min_y(-8), width(16), height(16), cells(width * height, Cell::UNKNOWN) {}
+
+    Cell get(coord_t pos) const {
+        if (!contains(pos)) return Cell::UNKNOWN;
+        return cells[index(pos)];
     }
-    return cpu.run_one_instruction();
-}
 
-std::pair<CPU, int> run_robot(CPU cpu, const path_t& path) {
-    int out_code = -1;
-    for (auto m : path) {
-        cpu.get_ostream() << m << std::endl;
-        run_until_output_is_produced(cpu);
-        cpu.get_istream() >> out_code;
+    void set(coord_t pos, Cell cell) {
+        while (!contains(pos)) grow();
+        cells[index(pos)] = cell;
+    }
+
+    bool contains(coord_t pos) const {
+        return pos.first >= min_x && pos.first < min_x + width &&
+               pos.second >= min_y && pos.second < min_y + height;
+    }
+
+    size_t size() const { return cells.size(); }
+
+    size_t index(coord_t pos) const {
+        return (pos.second - min_y) * width + (pos.first - min_x);
     }
-    return {cpu, out_code};
-}
 
-std::pair<CPU, int> step_robot(CPU cpu, int move) {
+private:
+    int min_x, min_y, width, height;
+    std::vector<Cell> cells;
+
+    void grow() {
+        std::vector<Cell> grown(4 * cells.size(), Cell::UNKNOWN);
+        for (int y = 0; y < height; y++) {
+            std::copy(
+                cells.begin() + y * width,
+                cells.begin() + (y + 1) * width,
+                grown.begin() + (y + height / 2) * 2 * width + width / 2
+            );
+        }
+        min_x -= width / 2;
+        min_y -= height / 2;
+        width *= 2;
+        height *= 2;
+        cells.swap(grown);
+    }
+};
+
+int step_robot(CPU& cpu, int move) {
     int out_code = -1;
     cpu.get_ostream() << move << std::endl;
-    run_until_output_is_produced(cpu);
+    cpu.run_until(STOP_ON_OUTPUT);
     cpu.get_istream() >> out_code;
-    return {cpu, out_code};
+    return out_code;
 }
 
 coord_t step(coord_t pos, int move) {
@@ -46,111 +77,94 @@ coord_t step(coord_t pos, int move) {
     return pos;
 }
 
-std::pair<int,int> get_pos(const path_t& path) {
-    int x = 0, y = 0;
-    for (auto m : path) {
-        switch (m) { case 1: y--; break;
-                     case 2: y++; break;
-                     case 3: x--; break;
-                     case 4: x++; break; }
-    }
-    return std::pair<int,int>(x, y);
+int opposite(int move) {
+    switch (move) { case 1: return 2;
+                    case 2: return 1;
+                    case 3: return 4;
+                    default: return 3; }
 }
 
-path_t path_to_oxygen_tank(const Tape& tape_in) {
+// Walks a single droid through the whole area with a backtracking depth first search: it
+// tries every unexplored neighbor, and walks back the way it came once there are none left
+Grid map_area(const Tape& tape_in, coord_t& oxygen_pos) {
     std::stringbuf buf;
     std::istream in(&buf);
     std::ostream out(&buf);
     Tape tape(tape_in);
-    CPU initial_cpu(tape, in, out);
-    // const auto& initial_cpu = run_robot(cpu_in, {}).first;
-
-    std::queue<std::tuple<CPU, coord_t, path_t>> paths;
-    for (auto move : moves) paths.push({initial_cpu, {0,0}, {move}});
-
-    std::set<std::pair<int,int>> visited;
-
-    while(paths.size() > 0) {
-        auto path = paths.front();
-        paths.pop();
-
-        auto old_cpu = std::get<0>(path);
-        auto pos = std::get<1>(path);
-        auto actual_path = std::get<2>(path);
+    CPU cpu(tape, in, out);
+
+    Grid grid;
+    coord_t pos = {0, 0};
+    grid.set(pos, Cell::OPEN);
+
+    std::vector<int> path;
+    while (true) {
+        bool moved = false;
+        for (auto move : moves) {
+            auto next = step(pos, move);
+            if (grid.get(next) != Cell::UNKNOWN) continue;
+
+            auto code = step_robot(cpu, move);
+            if (code == 0) {
+                grid.set(next, Cell::WALL);
+                continue;
+            }
 
-        auto cpu_code = step_robot(old_cpu, actual_path.back());
-        const auto& new_cpu = cpu_code.first;
-        const auto& code = cpu_code.second;
+            grid.set(next, code == 2 ? Cell::OXYGEN : Cell::OPEN);
+            if (code == 2) oxygen_pos = next;
 
-        if (code == 2) {
-            return actual_path;
-        } else if (code == 1) {
-            auto new_pos = step(pos, actual_path.back());
+            pos = next;
+            path.push_back(move);
+            moved = true;
+            break;
+        }
 
-            if (visited.count(new_pos) > 0) continue;
-            visited.insert(new_pos);
+        if (moved) continue;
+        if (path.empty()) break;
 
-            for (auto move : moves) {
-                auto new_path(actual_path);
-                new_path.push_back(move);
-                paths.push({new_cpu, new_pos, new_path});
-            }
-        }
+        auto back = opposite(path.back());
+        path.pop_back();
+        step_robot(cpu, back);
+        pos = step(pos, back);
     }
-    return path_t();
+    return grid;
 }
 
-int simulate_oxygen_dispersion(const Tape& tape_in, const path_t& initial_path) {
-    std::stringbuf buf;
-    std::istream in(&buf);
-    std::ostream out(&buf);
-    Tape tape(tape_in);
-    CPU cpu_in(tape, in, out);
-    const auto& initial_cpu = run_robot(cpu_in, initial_path).first;
-
-    std::queue<std::tuple<CPU, coord_t, int, int>> paths;
-    for (auto move : moves) paths.push({initial_cpu, {0,0}, move, 0});
-
-    std::set<std::pair<int,int>> visited;
-
-    int max_steps = 0;
-    while (paths.size() > 0) {
-        auto path = paths.front();
-        paths.pop();
-
-        auto old_cpu = std::get<0>(path);
-        auto pos = std::get<1>(path);
-        auto move = std::get<2>(path);
-        auto steps = std::get<3>(path);
-
-        auto cpu_code = step_robot(old_cpu, move);
-        const auto& new_cpu = cpu_code.first;
-        const auto& code = cpu_code.second;
-
-        if (code != 0) {
-            steps++;
-            auto new_pos = step(pos, move);
-
-            if (visited.count(new_pos) > 0) continue;
-            visited.insert(new_pos);
-
-            max_steps = steps > max_steps ? steps : max_steps;
-            for (auto move : moves) {
-                paths.push({new_cpu, new_pos, move, steps});
-            }
+// Breadth first search over the open cells of the map. Returns the distance from `from`
+// to every cell, indexed like the grid (-1 for cells that can't be reached)
+std::vector<int> distances_from(const Grid& grid, coord_t from) {
+    std::vector<int> dist(grid.size(), -1);
+    std::queue<coord_t> queue;
+
+    dist[grid.index(from)] = 0;
+    queue.push(from);
+
+    while (!queue.empty()) {
+        auto pos = queue.front();
+        queue.pop();
+        auto d = dist[grid.index(pos)];
+
+        for (auto move : moves) {
+            auto next = step(pos, move);
+            auto cell = grid.get(next);
+            if (cell == Cell::UNKNOWN || cell == Cell::WALL || dist[grid.index(next)] != -1) continue;
+            dist[grid.index(next)] = d + 1;
+            queue.push(next);
         }
     }
-    return max_steps;
+    return dist;
 }
 
 int main() {
     const Tape tape = read_tape_from_disk("input.txt");
 
+    coord_t oxygen_pos = {0, 0};
+    auto grid = map_area(tape, oxygen_pos);
+
     // Part 1
-    auto path = path_to_oxygen_tank(tape);
-    std::cout << "Part 1: " << path.size() << std::endl;
+    auto from_tank = distances_from(grid, oxygen_pos);
+    std::cout << "Part 1: " << from_tank[grid.index({0, 0})] << std::endl;
 
-    // Part 2
-    auto max_steps = simulate_oxygen_dispersion(tape, path);
-    std::cout << "Part 2: " << max_steps << std::endl;
+    // Part 2: the time to fill the area is the distance to the cell farthest from the tank
+    std::cout << "Part 2: " << *std::max_element(from_tank.begin(), from_tank.end()) << std::endl;
 }
\ No newline at end of file
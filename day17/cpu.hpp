@@ -1,6 +1,7 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <string>
 #include <vector>
 #include <unordered_map>
 
@@ -37,7 +38,9 @@ public:
         pc(0),
         relative_addr_base(0),
         in(in),
-        out(out) {}
+        out(out),
+        ascii_in_pos(0),
+        capturing_ascii(false) {}
 
     InstrExecStatus run_program() {
         InstrExecStatus status;
@@ -45,6 +48,34 @@ public:
         return status;
     }
 
+    // Queues `text` to be fed to the program one character per INPUT instruction
+    void write_ascii(const std::string& text) {
+        if (ascii_in_pos == ascii_in.size()) {
+            ascii_in.clear();
+            ascii_in_pos = 0;
+        }
+        ascii_in.append(text);
+    }
+
+    // Runs the program, collecting its ASCII output, until it outputs `delim` (included in
+    // the result), outputs a non-ASCII value (left in the regular output), halts, or
+    // the program needs input that was not queued with `write_ascii`.
+    // The returned buffer is overwritten by the next call
+    const std::string& read_ascii_until(char delim) {
+        ascii_out.clear();
+        capturing_ascii = true;
+        while (true) {
+            auto opcode = static_cast<OpCodes>(peek_current_opcode() % 100);
+            if (opcode == OpCodes::INPUT && ascii_in_pos == ascii_in.size()) break;
+
+            auto size = ascii_out.size();
+            if (run_one_instruction() != InstrExecStatus::ALL_GOOD) break;
+            if (opcode == OpCodes::OUTPUT && (ascii_out.size() == size || ascii_out.back() == delim)) break;
+        }
+        capturing_ascii = false;
+        return ascii_out;
+    }
+
     int peek_current_opcode() {
         return tape[pc];
     }
@@ -67,9 +98,10 @@ public:
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::INPUT: {
-                int n;
+                long long int n;
                 auto addrs = eval_operand_addrs(1, modes, pc + 1);
-                in >> n;
+                if (ascii_in_pos < ascii_in.size()) n = ascii_in[ascii_in_pos++];
+                else in >> n;
                 // std::cout << "Consumed " << n << std::endl;
                 tape[addrs[0]] = n;
                 pc += 2;
@@ -78,7 +110,9 @@ public:
             case OpCodes::OUTPUT: {
                 auto addrs = eval_operand_addrs(1, modes, pc + 1);
                 // std::cout << "Will produce " << tape[addrs[0]] << std::endl;
-                out << tape[addrs[0]] << std::endl;
+                auto value = tape[addrs[0]];
+                if (capturing_ascii && value >= 0 && value < 128) ascii_out.push_back(static_cast<char>(value));
+                else out << value << std::endl;
                 pc += 2;
                 return InstrExecStatus::ALL_GOOD;
             }
@@ -135,6 +169,14 @@ private:
     std::istream &in;
     std::ostream &out;
 
+    // Text queued with `write_ascii`. It is fed to INPUT instructions before anything in `in`
+    std::string ascii_in;
+    size_t ascii_in_pos;
+
+    // Text collected by `read_ascii_until`. Reused between calls
+    std::string ascii_out;
+    bool capturing_ascii;
+
     int eval_operand_addr(int mode, size_t position) {
         switch (static_cast<AddressingModes>(mode)) {
             case AddressingModes::POSITION:  return tape[position];
@@ -154,7 +196,7 @@ private:
 
 Tape read_tape_from_disk(std::string filename) {
     Tape tape;
-    std::ifstream file(filename, 0);
+    std::ifstream file(filename);
 
     size_t head_pos = 0;
     std::string val;
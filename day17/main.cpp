@@ -1,7 +1,9 @@
 #include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <map>
 #include <numeric>
+#include <string>
 #include <vector>
 
 #include "cpu.hpp"
@@ -17,12 +19,12 @@ std::vector<coord_t> neighbors{
     {-1, 0}, {0, 1}, {1, 0}, {0, -1}
 };
 
-grid_t parse_grid(std::istream& in) {
+grid_t parse_grid(const std::string& camera) {
     grid_t grid;
-    int i, x = 0, y = 0;
-    while (in >> i) {
-        if (i == '\n') { y++; x = 0; }
-        else { grid[{y,x++}] = i; }
+    int x = 0, y = 0;
+    for (auto c : camera) {
+        if (c == '\n') { y++; x = 0; }
+        else { grid[{y,x++}] = c; }
     }
 
     return grid;
@@ -43,16 +45,161 @@ inline bool is_intersection(const grid_t& grid, coord_t pos) {
     );
 }
 
-void part1(Tape tape) {
+// One movement command: turn left or right, then go forward `steps` cells
+struct Move {
+    char turn;
+    int steps;
+
+    bool operator==(const Move& other) const { return turn == other.turn && steps == other.steps; }
+};
+
+// Walks the whole scaffold from the robot's position: go straight as far as possible, then
+// turn towards the only way the scaffold continues. Crossing intersections straight is
+// what makes a single path cover every piece of scaffold
+std::vector<Move> walk_scaffold(const grid_t& grid) {
+    auto is_scaffold = [&grid](coord_t pos) {
+        auto it = grid.find(pos);
+        return it != grid.end() && is_grid(it->second);
+    };
+
+    const std::string robot_chars("^>v<");
+    coord_t pos;
+    size_t dir = 0;
+    for (const auto& kv : grid) {
+        auto d = robot_chars.find(kv.second);
+        if (d != std::string::npos) {
+            pos = kv.first;
+            dir = d;
+        }
+    }
+
+    // Clockwise, starting from up, same order as the robot characters
+    const std::vector<coord_t> dirs{{-1, 0}, {0, 1}, {1, 0}, {0, -1}};
+
+    std::vector<Move> moves;
+    while (true) {
+        char turn = 0;
+        if (is_scaffold(pos + dirs[(dir + 3) % 4])) { turn = 'L'; dir = (dir + 3) % 4; }
+        else if (is_scaffold(pos + dirs[(dir + 1) % 4])) { turn = 'R'; dir = (dir + 1) % 4; }
+        else break;
+
+        int steps = 0;
+        while (is_scaffold(pos + dirs[dir])) {
+            pos = pos + dirs[dir];
+            steps++;
+        }
+        moves.push_back({turn, steps});
+    }
+    return moves;
+}
+
+std::string to_string(std::vector<Move>::const_iterator begin, std::vector<Move>::const_iterator end) {
+    std::string s;
+    for (auto it = begin; it != end; it++) {
+        if (!s.empty()) s += ",";
+        s += std::string(1, it->turn) + "," + std::to_string(it->steps);
+    }
+    return s;
+}
+
+// Splits a list of moves into a main routine calling up to `max_functions` movement
+// functions, where the routine and each function fit in `max_chars` characters.
+//
+// Depth first search over the moves: at each position, either call a function that matches
+// the moves that follow, or define the next unused function as some prefix of them.
+// Functions are always defined in order (A, then B, ...), so equivalent assignments that
+// only differ in naming are never explored twice, and (position, functions) states that
+// are known to fail are remembered
+class Compressor {
+public:
+    Compressor(const std::vector<Move>& moves, size_t max_functions, size_t max_chars):
+        moves(moves), max_functions(max_functions), max_chars(max_chars) {}
+
+    bool solve() {
+        routine.clear();
+        functions.clear();
+        failed.clear();
+        return search(0);
+    }
+
+    // Main routine and function definitions, one per line, in the format the robot expects
+    std::string program() const {
+        std::string s;
+        for (auto f : routine) s += std::string(s.empty() ? "" : ",") + static_cast<char>('A' + f);
+        s += "\n";
+        for (size_t f = 0; f < max_functions; f++) {
+            if (f < functions.size()) s += to_string(moves.begin() + functions[f].first, moves.begin() + functions[f].first + functions[f].second);
+            s += "\n";
+        }
+        return s;
+    }
+
+private:
+    const std::vector<Move>& moves;
+    const size_t max_functions;
+    const size_t max_chars;
+
+    std::vector<size_t> routine;
+
+    // (first move, number of moves) of each function
+    std::vector<std::pair<size_t,size_t>> functions;
+
+    // Searches that failed, by position and functions, with the shortest main routine they
+    // failed with. A longer routine has fewer calls left, so it fails there too
+    std::map<std::pair<size_t,std::vector<std::pair<size_t,size_t>>>,size_t> failed;
+
+    bool matches(size_t pos, const std::pair<size_t,size_t>& function) const {
+        return pos + function.second <= moves.size() && std::equal(
+            moves.begin() + function.first,
+            moves.begin() + function.first + function.second,
+            moves.begin() + pos
+        );
+    }
+
+    bool call(size_t pos, size_t f) {
+        routine.push_back(f);
+        if (search(pos + functions[f].second)) return true;
+        routine.pop_back();
+        return false;
+    }
+
+    bool search(size_t pos) {
+        if (pos == moves.size()) return true;
+
+        // One more call adds a letter, and a comma if it's not the first one
+        if (2 * routine.size() + 1 > max_chars) return false;
+        auto it = failed.find({pos, functions});
+        if (it != failed.end() && routine.size() >= it->second) return false;
+
+        for (size_t f = 0; f < functions.size(); f++) {
+            if (matches(pos, functions[f]) && call(pos, f)) return true;
+        }
+
+        if (functions.size() < max_functions) {
+            for (size_t len = 1; pos + len <= moves.size(); len++) {
+                if (to_string(moves.begin() + pos, moves.begin() + pos + len).size() > max_chars) break;
+
+                functions.push_back({pos, len});
+                if (call(pos, functions.size() - 1)) return true;
+                functions.pop_back();
+            }
+        }
+
+        auto& shortest = failed.emplace(std::make_pair(pos, functions), routine.size()).first->second;
+        shortest = std::min(shortest, routine.size());
+        return false;
+    }
+};
+
+grid_t part1(Tape tape) {
     std::stringbuf buf;
     std::istream in(&buf);
     std::ostream out(&buf);
 
     CPU cpu(tape, in, out);
 
-    cpu.run_program();
-
-    auto grid = parse_grid(in);
+    // The camera output is all ASCII, so this runs until the program halts
+    auto grid = parse_grid(cpu.read_ascii_until('\0'));
 
     auto sum = std::accumulate(
         grid.begin(),
@@ -64,9 +211,11 @@ void part1(Tape tape) {
     );
 
     std::cout << "Part 1: " << sum << std::endl;
+
+    return grid;
 }
 
-void part2(Tape tape) {
+void part2(Tape tape, const grid_t& grid, size_t max_functions = 3, size_t max_chars = 20) {
     std::stringbuf buf;
     std::istream in(&buf);
     std::ostream out(&buf);
@@ -74,29 +223,34 @@ void part2(Tape tape) {
     tape[0] = 2;
     CPU cpu(tape, in, out);
 
+    auto start = std::chrono::steady_clock::now();
+    auto moves = walk_scaffold(grid);
+    Compressor compressor(moves, max_functions, max_chars);
+    if (!compressor.solve()) {
+        std::cout << "Part 2: no way to compress " << to_string(moves.begin(), moves.end()) << std::endl;
+        return;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
 
-    // Using attempt #2 from part2-manual-solve.txt
-    std::string code(R"(A,B,B,C,A,B,C,A,B,C
-L,6,R,12,L,4,L,6
-R,6,L,6,R,12
-L,6,L,10,L,10,R,6
-n
-)");
+    std::string code = compressor.program() + "n\n";
+    std::cout << "Found movement functions in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() << "us:" << std::endl
+              << code;
 
-    for (auto c : code) out << static_cast<int>(c) << std::endl;
+    cpu.write_ascii(code);
 
-    cpu.run_program();
-    int i;
-    while(in >> i) {
-        std::cout << static_cast<char>(i);
-    }
+    // Stops at the first non-ASCII output, which is the score
+    std::cout << cpu.read_ascii_until('\0');
+
+    long long int score;
+    in >> score;
 
-    std::cout << std::endl << "Part 2: score: " << i << std::endl;
+    std::cout << std::endl << "Part 2: score: " << score << std::endl;
 }
 
 int main() {
     const Tape tape = read_tape_from_disk("input.txt");
 
-    part1(tape);
-    part2(tape);
+    auto grid = part1(tape);
+    part2(tape, grid);
 }
\ No newline at end of file
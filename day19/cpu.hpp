@@ -1,6 +1,12 @@
+#include <atomic>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <fstream>
 #include <sstream>
+#include <thread>
 #include <vector>
 #include <unordered_map>
 
@@ -8,7 +14,16 @@
 using Tape = std::unordered_map<size_t,long int>;
 
 enum class InstrExecStatus {
-    IDLE, ALL_GOOD, HALT, UNKOWN_OPCODE, NO_INPUT,
+    IDLE, ALL_GOOD, HALT, UNKOWN_OPCODE, NO_INPUT, OUTPUT, OUT_OF_BUDGET,
+};
+
+// Events `CPU::run_until` stops on, besides the program halting. Combine them with |
+enum StopMask : unsigned {
+    // Before an INPUT instruction, if there is no input to read
+    STOP_ON_INPUT  = 1 << 0,
+
+    // After the nth OUTPUT instruction
+    STOP_ON_OUTPUT = 1 << 1,
 };
 
 enum class OpCodes {
@@ -39,30 +54,82 @@ public:
         in(in),
         out(out) {}
 
+    // Restores the program image the CPU was created with, by undoing every write since the
+    // last reset, most recent first. Cells that were only read come back as 0, which is
+    // what reading an absent cell gives anyway
+    void reset() {
+        for (auto it = undo_log.rbegin(); it != undo_log.rend(); it++) {
+            tape[it->first] = it->second;
+        }
+        undo_log.clear();
+        pc = 0;
+        relative_addr_base = 0;
+    }
+
     InstrExecStatus run_program() {
-        InstrExecStatus status;
-        while((status = run_one_instruction()) == InstrExecStatus::ALL_GOOD);
-        return status;
+        return run_until(0);
+    }
+
+    // Runs until the program halts, stops on one of the `stop` events, or `budget`
+    // instructions ran. Each instruction word is fetched once, and events are only checked
+    // for the INPUT and OUTPUT instructions
+    InstrExecStatus run_until(unsigned stop, uint64_t n = 1,
+                              uint64_t budget = std::numeric_limits<uint64_t>::max()) {
+        uint64_t outputs = 0;
+        for (; budget > 0; budget--) {
+            auto instr = tape[pc];
+            auto opcode = instr % 100;
+            if (opcode == static_cast<int>(OpCodes::INPUT) && (stop & STOP_ON_INPUT) && !has_pending_input()) {
+                return InstrExecStatus::NO_INPUT;
+            }
+
+            auto status = execute(opcode, instr / 100);
+            if (status != InstrExecStatus::ALL_GOOD) return status;
+            if (opcode == static_cast<int>(OpCodes::OUTPUT) && (stop & STOP_ON_OUTPUT) && ++outputs == n) {
+                return InstrExecStatus::OUTPUT;
+            }
+        }
+        return InstrExecStatus::OUT_OF_BUDGET;
+    }
+
+    InstrExecStatus run_one_instruction() {
+        auto instr = tape[pc];
+        return execute(instr % 100, instr / 100);
+    }
+
+    // Whether there's a value to read. Skips the whitespace left after the previous value,
+    // and only blocks if the stream itself does (e.g. std::cin on a terminal)
+    bool has_pending_input() {
+        in >> std::ws;
+        bool pending = in.peek() != std::char_traits<char>::eof();
+        in.clear();
+        return pending;
     }
 
     int peek_current_opcode() {
         return tape[pc];
     }
 
-    InstrExecStatus run_one_instruction() {
-        auto opcode = tape[pc] % 100;
-        auto modes  = tape[pc] / 100;
+    std::istream& get_istream() { return in; }
+    std::ostream& get_ostream() { return out; }
 
+    void mem_dump(size_t start, size_t end) {
+        for (int i = start; i < end; i++) {
+            std::cout << i << ": " << tape[i] << std::endl;
+        }
+    }
+private:
+    InstrExecStatus execute(long long int opcode, long long int modes) {
         switch (static_cast<OpCodes>(opcode)) {
             case OpCodes::ADD: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] + tape[addrs[1]];
+                store(addrs[2], tape[addrs[0]] + tape[addrs[1]]);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::MULT: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] * tape[addrs[1]];
+                store(addrs[2], tape[addrs[0]] * tape[addrs[1]]);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
@@ -71,7 +138,7 @@ public:
                 auto addrs = eval_operand_addrs(1, modes, pc + 1);
                 in >> n;
                 // std::cout << "Consumed " << n << std::endl;
-                tape[addrs[0]] = n;
+                store(addrs[0], n);
                 pc += 2;
                 return InstrExecStatus::ALL_GOOD;
             }
@@ -94,13 +161,13 @@ public:
             }
             case OpCodes::LESS_THAN: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] < tape[addrs[1]] ? 1 : 0;
+                store(addrs[2], tape[addrs[0]] < tape[addrs[1]] ? 1 : 0);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::EQUALS: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] == tape[addrs[1]] ? 1 : 0;
+                store(addrs[2], tape[addrs[0]] == tape[addrs[1]] ? 1 : 0);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
@@ -115,15 +182,6 @@ public:
         }
     }
 
-    std::istream& get_istream() { return in; }
-    std::ostream& get_ostream() { return out; }
-
-    void mem_dump(size_t start, size_t end) {
-        for (int i = start; i < end; i++) {
-            std::cout << i << ": " << tape[i] << std::endl;
-        }
-    }
-private:
     Tape tape;
 
     // Program counter
@@ -135,6 +193,15 @@ private:
     std::istream &in;
     std::ostream &out;
 
+    // (address, previous value) of every write since the last reset
+    std::vector<std::pair<size_t,long int>> undo_log;
+
+    void store(size_t addr, long int value) {
+        auto& cell = tape[addr];
+        undo_log.push_back({addr, cell});
+        cell = value;
+    }
+
     int eval_operand_addr(int mode, size_t position) {
         switch (static_cast<AddressingModes>(mode)) {
             case AddressingModes::POSITION:  return tape[position];
@@ -152,9 +219,83 @@ private:
     }
 };
 
+// A CPU together with the buffer it reads its input from and writes its output to
+struct BufferedCPU {
+    BufferedCPU(const Tape& tape): in(&buf), out(&buf), cpu(tape, in, out) {}
+
+    std::stringbuf buf;
+    std::istream in;
+    std::ostream out;
+    CPU cpu;
+};
+
+// CPUs for one program image, one per thread, each reset between uses so many short runs
+// don't each pay for building a CPU and copying the whole image. The CPUs belong to the
+// pool and are freed with it, or by `clear`
+class CPUPool {
+public:
+    explicit CPUPool(const Tape& tape): tape(tape), id(next_id()) {}
+
+    // The calling thread's CPU, in its initial state and with empty I/O. It stays valid
+    // until the thread's next `acquire`, or until `clear`. Only a thread's first use of the
+    // pool takes the lock
+    BufferedCPU& acquire() {
+        auto& last = last_acquired();
+        if (last.pool_id != id) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& cpu = cpus[std::this_thread::get_id()];
+            last.pool_id = id;
+            if (!cpu) {
+                cpu.reset(new BufferedCPU(tape));
+                last.cpu = cpu.get();
+                return *cpu;
+            }
+            last.cpu = cpu.get();
+        }
+
+        auto pooled = last.cpu;
+        pooled->cpu.reset();
+        pooled->buf.str("");
+        pooled->in.clear();
+        pooled->out.clear();
+        return *pooled;
+    }
+
+    // Frees every CPU. None of them can be in use, and no thread can be in `acquire`
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        cpus.clear();
+        id = next_id();
+    }
+
+private:
+    // The pool a thread last acquired a CPU from, and that CPU. Pool ids are never reused
+    // and `clear` gives the pool a new one, so what a destroyed or cleared pool left here
+    // never matches
+    struct LastAcquired {
+        uint64_t pool_id;
+        BufferedCPU* cpu;
+    };
+
+    static LastAcquired& last_acquired() {
+        thread_local LastAcquired last{0, nullptr};
+        return last;
+    }
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> ids(1);
+        return ids++;
+    }
+
+    const Tape tape;
+    std::atomic<uint64_t> id;
+    std::mutex mutex;
+    std::unordered_map<std::thread::id,std::unique_ptr<BufferedCPU>> cpus;
+};
+
 Tape read_tape_from_disk(std::string filename) {
     Tape tape;
-    std::ifstream file(filename, 0);
+    std::ifstream file(filename);
 
     size_t head_pos = 0;
     std::string val;
@@ -1,79 +1,111 @@
+#include <chrono>
 #include <iostream>
 #include <sstream>
+#include <vector>
 
 #include "cpu.hpp"
 
-inline bool is_inside_beam(const Tape& tape, int x, int y) {
-    std::stringbuf buf;
-    std::istream in(&buf);
-    std::ostream out(&buf);
+inline bool is_inside_beam(CPUPool& pool, int x, int y) {
+    auto& pooled = pool.acquire();
 
-    CPU cpu(tape, in, out);
-    out << x << std::endl;
-    out << y << std::endl;
-    cpu.run_program();
+    pooled.out << x << std::endl;
+    pooled.out << y << std::endl;
+    // The answer is the only output, and the CPU gets reset before its next use anyway
+    pooled.cpu.run_until(STOP_ON_OUTPUT);
 
     int in_beam;
-    in >> in_beam;
+    pooled.in >> in_beam;
     return in_beam == 1;
 }
 
+// `is_inside_beam` on a pool of its own. Keeps track of how many VM runs were needed. No
+// point is probed twice by either part, so there is nothing to cache
+class BeamProbe {
+public:
+    BeamProbe(const Tape& tape): pool(tape), probes(0) {}
+
+    bool operator()(int x, int y) {
+        probes++;
+        return is_inside_beam(pool, x, y);
+    }
+
+    size_t get_probes() const { return probes; }
+
+private:
+    CPUPool pool;
+    size_t probes;
+};
+
+void print_probe_stats(const BeamProbe& probe, std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "  " << probe.get_probes() << " VM runs, "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << "ms" << std::endl;
+}
+
 void part1(const Tape& tape) {
     const int width = 50;
     const int height = width;
 
+    auto start = std::chrono::steady_clock::now();
+    BeamProbe probe(tape);
+
     size_t n = 0;
 
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
-            if (is_inside_beam(tape, x, y))
+            if (probe(x, y))
                 n++;
         }
     }
 
     std::cout << "Part 1: " << n << std::endl;
+    print_probe_stats(probe, start);
 }
 
-bool is_square_inside_beam(const Tape& tape, int x, int y, int width) {
-    return is_inside_beam(tape, x + width, y) && is_inside_beam(tape, x, y + width);
-}
-
-int find_min_y(const Tape& tape, int x, int square_width, int search_width) {
-    for (int y = 0; y < search_width; y++) {
-        if (is_square_inside_beam(tape, x, y, square_width)) {
-            return y;
-        }
-    }
-    return -1;
-}
-
+// Follows the left and right edges of the beam row by row. Both edges only ever move right
+// as y grows, so each row's edges are found by scanning on from the previous row's edges.
+// Rows close to the origin can be empty, in which case the previous edges are kept.
+//
+// A square of side `size` with its bottom-left corner at (x, y) fits in the beam iff x is
+// the left edge of row y and the top row, y - size + 1, still reaches x + size - 1: the
+// rows in between are at least as wide
 void part2(const Tape& tape) {
-    std::stringbuf buf;
-    std::istream in(&buf);
-    std::ostream out(&buf);
-
-    const int square_width = 100 - 1;
-    const int search_width = 5000;
-
-    // We'll do a binary search on the x axis, with a linear scan on
-    // the y axis for each tentative x value
-    int x_min = 0, x_max = search_width;
-
-    while (x_min != x_max) {
-        int x_middle = (x_min + x_max) / 2;
+    const int size = 100;
+    const int max_y = 100000;
+
+    auto start = std::chrono::steady_clock::now();
+    BeamProbe probe(tape);
+
+    // Right edge of each row, -1 for empty rows
+    std::vector<int> right_edges;
+
+    int left = 0, right = 0;
+    for (int y = 0; y < max_y; y++) {
+        // Rows close to the origin might be empty. The beam is never more than a few cells
+        // to the right of the previous row's edges
+        int x = left;
+        int limit = std::max(left, right) + 8;
+        while (x <= limit && !probe(x, y)) x++;
+
+        if (x > limit) {
+            right_edges.push_back(-1);
+            continue;
+        }
 
-        std::cout << "Trying x_middle: " << x_middle << std::endl;
+        left = x;
+        right = std::max(right, left);
+        while (probe(right + 1, y)) right++;
+        right_edges.push_back(right);
 
-        if (find_min_y(tape, x_middle, square_width, search_width) != -1) {
-            x_max = x_middle;
-        } else {
-            x_min = x_middle + 1;
+        int top = y - size + 1;
+        if (top >= 0 && right_edges[top] >= left + size - 1) {
+            std::cout << "Part 2: (" << left << ", " << top << ") => " << 10000 * left + top << std::endl;
+            print_probe_stats(probe, start);
+            return;
         }
     }
 
-    int y = find_min_y(tape, x_min, square_width, search_width);
-
-    std::cout << "Part 2: (" << x_min << ", " << y << ") => " << 10000 * x_min + y << std::endl;
+    std::cout << "Part 2: no fit up to y = " << max_y << std::endl;
 }
 
 int main() {
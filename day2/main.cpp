@@ -1,19 +1,38 @@
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <utility>
 #include <vector>
 
 enum class InstrExecStatus {
     ALL_GOOD, HALT, MAMMA_MIA_THATS_GONNA_BE_AN_ERROR
 };
 
-InstrExecStatus exec_instr(int pc, std::vector<int>& tape) {
+// (address, previous value) of every write to a tape, so it can be restored afterwards
+using undo_log_t = std::vector<std::pair<int,int>>;
+
+void write(std::vector<int>& tape, int addr, int value, undo_log_t& undo_log) {
+    undo_log.push_back({addr, tape[addr]});
+    tape[addr] = value;
+}
+
+// Undoes the logged writes, most recent first, which brings the tape back to its initial
+// state without copying all of it
+void reset_tape(std::vector<int>& tape, undo_log_t& undo_log) {
+    for (auto it = undo_log.rbegin(); it != undo_log.rend(); it++) {
+        tape[it->first] = it->second;
+    }
+    undo_log.clear();
+}
+
+InstrExecStatus exec_instr(int pc, std::vector<int>& tape, undo_log_t& undo_log) {
     switch (tape.at(pc)) {
         case 1:
-            tape[tape[pc + 3]] = tape[tape[pc + 1]] + tape[tape[pc + 2]];
+            write(tape, tape[pc + 3], tape[tape[pc + 1]] + tape[tape[pc + 2]], undo_log);
             return InstrExecStatus::ALL_GOOD;
         case 2:
-            tape[tape[pc + 3]] = tape[tape[pc + 1]] * tape[tape[pc + 2]];
+            write(tape, tape[pc + 3], tape[tape[pc + 1]] * tape[tape[pc + 2]], undo_log);
             return InstrExecStatus::ALL_GOOD;
         case 99:
             return InstrExecStatus::HALT;
@@ -23,10 +42,10 @@ InstrExecStatus exec_instr(int pc, std::vector<int>& tape) {
     return InstrExecStatus::ALL_GOOD;
 }
 
-void run_program(std::vector<int>& tape) {
+void run_program(std::vector<int>& tape, undo_log_t& undo_log) {
     // Program Counter
     int pc = 0;
-    while (exec_instr(pc, tape) == InstrExecStatus::ALL_GOOD)
+    while (exec_instr(pc, tape, undo_log) == InstrExecStatus::ALL_GOOD)
         pc += 4;
 }
 
@@ -48,27 +67,32 @@ void print_tape(const std::vector<int>& tape) {
 }
 
 int main() {
-    // Immutable tape we'll use for restoring the initial state
+    // Initial program image
     auto initial_tape = read_tape_from_disk("input.txt");
 
     // Part 1
 
+    // Every run works on this single tape, and is undone afterwards
     std::vector<int> tape(initial_tape);
-    tape[1] = 12;
-    tape[2] = 2;
+    undo_log_t undo_log;
+
+    write(tape, 1, 12, undo_log);
+    write(tape, 2, 2, undo_log);
 
-    run_program(tape);
+    run_program(tape, undo_log);
     std::cout << "Part 1: first tape cell contains: " << tape.at(0) << std::endl;
+    reset_tape(tape, undo_log);
 
     // Part 2
 
     for (int noun = 0; noun <= 99; noun++) {
         for (int verb = 0; verb <= 99; verb++) {
-            std::vector<int> tape(initial_tape);
-            tape[1] = noun;
-            tape[2] = verb;
-            run_program(tape);
-            if (tape[0] == 19690720) {
+            write(tape, 1, noun, undo_log);
+            write(tape, 2, verb, undo_log);
+            run_program(tape, undo_log);
+            bool found = tape[0] == 19690720;
+            reset_tape(tape, undo_log);
+            if (found) {
                 std::cout << "Part 2: found nount and verb such that 100*noun + verb = " << 100*noun + verb << std::endl;
                 return 0;
             }
@@ -1,6 +1,19 @@
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
 
 #include "cpu.hpp"
+#include "../intcode/parallel.hpp"
 
 void run_program(const Tape& tape, const std::string& code) {
     std::stringbuf buf;
@@ -9,16 +22,14 @@ void run_program(const Tape& tape, const std::string& code) {
 
     CPU cpu(tape, in, out);
 
-    for (auto c : code) out << static_cast<int>(c) << std::endl;
+    cpu.write_ascii(code);
 
-    cpu.run_program();
-    int v;
-    while (in >> v) {
-        if (v <= '~')
-            std::cout << static_cast<char>(v);
-        else
-            std::cout << "Score: " << v << std::endl;
-    }
+    // Either the whole output is ASCII (the droid fell into space), or the
+    // text stops at the first non-ASCII value, which is the score
+    std::cout << cpu.read_ascii_until('\0');
+
+    long long int score;
+    if (in >> score) std::cout << "Score: " << score << std::endl;
 }
 
 void part1(const Tape& tape) {
@@ -58,12 +69,413 @@ RUN
     run_program(tape, code);
 }
 
-int main() {
+enum class SpringOp {
+    AND, OR, NOT,
+};
+
+struct SpringInstr {
+    SpringOp op;
+
+    // A-I, T or J
+    char src;
+
+    // T or J
+    char dst;
+};
+
+using Springscript = std::vector<SpringInstr>;
+
+std::string to_string(const Springscript& script, const std::string& mode) {
+    const std::string op_names[] = {"AND", "OR", "NOT"};
+    std::string code;
+    for (const auto& instr : script) {
+        code += op_names[static_cast<int>(instr.op)] + " " + instr.src + " " + instr.dst + "\n";
+    }
+    return code + mode + "\n";
+}
+
+// The firmware run up to its "Input instructions:" prompt. Every program is tried on a
+// fork of it, so the start up is only paid once
+class Firmware {
+public:
+    explicit Firmware(const Tape& tape): in(&buf), out(&buf), snapshot(tape, in, out) {
+        snapshot.read_ascii_until('\0');
+    }
+
+    // Whether the droid makes it across with `code`. The firmware's text output, which draws
+    // the hull the droid fell into otherwise, is left in `text`
+    bool accepts(const std::string& code, long long int& score, std::string& text) const {
+        std::stringbuf fork_buf;
+        std::istream fork_in(&fork_buf);
+        std::ostream fork_out(&fork_buf);
+
+        CPU cpu(snapshot, fork_in, fork_out);
+        cpu.write_ascii(code);
+        text = cpu.read_ascii_until('\0');
+        return static_cast<bool>(fork_in >> score);
+    }
+
+private:
+    std::stringbuf buf;
+    std::istream in;
+    std::ostream out;
+    CPU snapshot;
+};
+
+// A hull the droid fell through: '#' is ground and '.' a hole. The droid starts on the first
+// cell, and there's only ground past the last one
+using Hull = std::string;
+
+// The firmware draws every step of a failed attempt, four rows each with the hull last. The
+// droid is still standing above the hull in the first drawing, so that hull row is intact
+bool parse_hull(const std::string& text, Hull& hull) {
+    auto pos = text.find("Didn't make it across:");
+    if (pos == std::string::npos) return false;
+
+    std::istringstream lines(text.substr(pos));
+    std::string line;
+    std::getline(lines, line);
+
+    hull.clear();
+    while (std::getline(lines, line)) {
+        if (!line.empty()) hull = line;
+        else if (!hull.empty()) break;
+    }
+    return !hull.empty() && hull.find('@') == std::string::npos;
+}
+
+// Sensor readings at `pos`: bit k is set if there's ground k + 1 cells ahead
+unsigned sensors_at(const Hull& hull, size_t pos, size_t n_sensors) {
+    unsigned sensors = 0;
+    for (size_t k = 0; k < n_sensors; k++) {
+        if (pos + k + 1 >= hull.size() || hull[pos + k + 1] == '#') sensors |= 1 << k;
+    }
+    return sensors;
+}
+
+// Moves the droid across `hull` like the firmware does. On every cell it lands on,
+// `jumps(sensors)` decides whether it jumps, which takes it 4 cells ahead
+template <typename Jumps>
+bool crosses(const Hull& hull, size_t n_sensors, Jumps jumps) {
+    for (size_t pos = 0; pos < hull.size(); ) {
+        pos += jumps(sensors_at(hull, pos, n_sensors)) ? 4 : 1;
+        if (pos < hull.size() && hull[pos] == '.') return false;
+    }
+    return true;
+}
+
+// Runs `script` on the droid's sensor readings and returns J
+bool run_springscript(const Springscript& script, unsigned sensors) {
+    bool t = false, j = false;
+    for (const auto& instr : script) {
+        bool src = instr.src == 'T' ? t : instr.src == 'J' ? j : (sensors >> (instr.src - 'A')) & 1;
+        bool& dst = instr.dst == 'T' ? t : j;
+        switch (instr.op) {
+            case SpringOp::AND: dst = dst && src; break;
+            case SpringOp::OR:  dst = dst || src; break;
+            case SpringOp::NOT: dst = !src; break;
+        }
+    }
+    return j;
+}
+
+// Every sensor reading the droid can get on `hulls`, wherever its jumps take it
+std::vector<unsigned> reachable_sensors(const std::vector<Hull>& hulls, size_t n_sensors) {
+    std::vector<unsigned> readings;
+    for (const auto& hull : hulls) {
+        for (size_t pos = 0; pos < hull.size(); pos++) {
+            if (hull[pos] == '#') readings.push_back(sensors_at(hull, pos, n_sensors));
+        }
+    }
+    std::sort(readings.begin(), readings.end());
+    readings.erase(std::unique(readings.begin(), readings.end()), readings.end());
+    return readings;
+}
+
+// Value of a register for every sensor reading the droid can get: bit r is the value for
+// the rth reachable reading. Sized for all 512 readings of RUN mode's 9 sensors
+using truth_table_t = std::bitset<512>;
+
+struct Registers {
+    truth_table_t t, j;
+
+    bool operator==(const Registers& other) const { return t == other.t && j == other.j; }
+};
+
+struct RegistersHash {
+    size_t operator()(const Registers& regs) const {
+        std::hash<truth_table_t> hash;
+        return hash(regs.t) * 31 + hash(regs.j);
+    }
+};
+
+// Adjacent instructions that neither read nor write each other's register can be swapped.
+// Only the order with the smaller instruction first is explored
+bool is_canonical(const SpringInstr& prev, const SpringInstr& next) {
+    bool independent = prev.dst != next.dst && prev.src != next.dst && next.src != prev.dst;
+    if (!independent) return true;
+    return std::make_tuple(prev.op, prev.src, prev.dst) < std::make_tuple(next.op, next.src, next.dst);
+}
+
+struct SearchStats {
+    uint64_t states = 0;
+    double expand_seconds = 0;
+    uint64_t candidates = 0;
+    double check_seconds = 0;
+    uint64_t firmware_runs = 0;
+    double firmware_seconds = 0;
+};
+
+struct SearchNode {
+    Registers regs;
+    Springscript script;
+};
+
+// Frontier node `origin` followed by `instr`, which leaves the registers in `regs`
+struct Expansion {
+    size_t origin;
+    SpringInstr instr;
+    Registers regs;
+};
+
+// Searches for the shortest springscript program (up to `max_length` instructions) that
+// gets the droid across every one of `hulls`, trying every program of a given length before
+// any longer one. States are expanded and candidates checked natively, on all cores.
+//
+// Registers only hold values for the sensor readings that can occur on `hulls`, and programs
+// are only extended if they leave T and J in a state that no other program reached yet,
+// which removes no-ops, swapped instructions and any other rewrite of the same logic. Only
+// programs whose J is new are candidates.
+//
+// Past `max_states` new states for one length the rest are dropped, and the result is then
+// not necessarily the shortest program.
+//
+// Every state reached stays in `seen` until the search returns, about 170 bytes each, and
+// the current and next lengths hold up to `max_states` nodes of about 220 bytes each. So the
+// search needs at most `search_bytes_per_state(max_length) * max_states` bytes
+size_t search_bytes_per_state(size_t max_length) {
+    return 440 + 170 * max_length;
+}
+
+bool search(const std::string& mode, const std::vector<Hull>& hulls, size_t max_length, size_t max_states,
+            Springscript& found, SearchStats& stats) {
+    const std::string sensors(mode == "RUN" ? "ABCDEFGHI" : "ABCD");
+    const auto readings = reachable_sensors(hulls, sensors.size());
+
+    std::vector<size_t> row_of(1 << sensors.size());
+    truth_table_t all_rows;
+    for (size_t r = 0; r < readings.size(); r++) {
+        row_of[readings[r]] = r;
+        all_rows.set(r);
+    }
+
+    std::map<char,truth_table_t> sensor_tables;
+    for (size_t k = 0; k < sensors.size(); k++) {
+        truth_table_t table;
+        for (size_t r = 0; r < readings.size(); r++) table[r] = (readings[r] >> k) & 1;
+        sensor_tables[sensors[k]] = table;
+    }
+
+    std::vector<SpringInstr> instructions;
+    for (auto op : {SpringOp::AND, SpringOp::OR, SpringOp::NOT}) {
+        for (auto src : sensors + "TJ") {
+            for (auto dst : {'T', 'J'}) instructions.push_back({op, src, dst});
+        }
+    }
+
+    auto passes = [&](const truth_table_t& j) {
+        for (const auto& hull : hulls) {
+            if (!crosses(hull, sensors.size(), [&](unsigned s) { return j[row_of[s]]; })) return false;
+        }
+        return true;
+    };
+
+    std::vector<SearchNode> frontier{{Registers(), Springscript()}};
+    std::unordered_set<Registers, RegistersHash> seen{frontier[0].regs};
+    std::unordered_set<truth_table_t> tried{frontier[0].regs.j};
+
+    // Never jumping is the empty program
+    stats.candidates++;
+    if (passes(frontier[0].regs.j)) {
+        found.clear();
+        return true;
+    }
+
+    // Applies `instr` to `regs`
+    auto execute = [&](Registers regs, const SpringInstr& instr) {
+        auto& dst = instr.dst == 'T' ? regs.t : regs.j;
+        const auto src = instr.src == 'T' ? regs.t : instr.src == 'J' ? regs.j : sensor_tables.at(instr.src);
+        switch (instr.op) {
+            case SpringOp::AND: dst &= src; break;
+            case SpringOp::OR:  dst |= src; break;
+            case SpringOp::NOT: dst = ~src & all_rows; break;
+        }
+        return regs;
+    };
+
+    for (size_t length = 1; length <= max_length && !frontier.empty(); length++) {
+        std::vector<SearchNode> next;
+        std::vector<size_t> candidates;
+
+        // The frontier is expanded a batch at a time, in slices spread over the cores. Each
+        // slice drops the states that earlier lengths reached (`seen` is only read meanwhile)
+        // and the ones it already produced itself. Merging the slices in order then gives
+        // the same next level, in the same order, as expanding the frontier serially
+        const size_t slice_size = 64;
+        auto origin = frontier.size();
+        auto expand_start = std::chrono::steady_clock::now();
+        for (size_t begin = 0, end; begin < frontier.size() && next.size() < max_states; begin = end) {
+            // Every node adds at most one state per instruction, so a batch never expands
+            // many more nodes than it takes to reach `max_states`
+            auto batch_size = std::min<size_t>(64 * slice_size, (max_states - next.size()) / instructions.size() + 1);
+            end = std::min(frontier.size(), begin + batch_size);
+
+            // The new states of each slice. Scripts are only copied for the ones that survive
+            // the merge
+            std::vector<std::vector<Expansion>> slices((end - begin + slice_size - 1) / slice_size);
+            parallel_for(slices.size(), [&](size_t s) {
+                for (auto i = begin + s * slice_size; i < std::min(end, begin + (s + 1) * slice_size); i++) {
+                    const auto& node = frontier[i];
+                    for (const auto& instr : instructions) {
+                        if (!node.script.empty() && !is_canonical(node.script.back(), instr)) continue;
+
+                        auto regs = execute(node.regs, instr);
+                        if (seen.count(regs) > 0) continue;
+
+                        slices[s].push_back({i, instr, regs});
+                    }
+                }
+            });
+
+            for (auto& slice : slices) {
+                for (const auto& expansion : slice) {
+                    // Past `max_states`, no further frontier node gets expanded
+                    if (expansion.origin != origin && next.size() >= max_states) break;
+                    origin = expansion.origin;
+
+                    if (!seen.insert(expansion.regs).second) continue;
+                    if (tried.insert(expansion.regs.j).second) candidates.push_back(next.size());
+                    next.push_back({expansion.regs, frontier[expansion.origin].script});
+                    next.back().script.push_back(expansion.instr);
+                }
+            }
+        }
+
+        stats.states += next.size();
+        stats.expand_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - expand_start).count();
+
+        // The first passing candidate in search order wins, so results don't depend on timing
+        std::atomic<size_t> first_passing(candidates.size());
+        auto check_start = std::chrono::steady_clock::now();
+        parallel_for(candidates.size(), [&](size_t i) {
+            if (i > first_passing || !passes(next[candidates[i]].regs.j)) return;
+
+            auto current = first_passing.load();
+            while (i < current && !first_passing.compare_exchange_weak(current, i));
+        });
+        stats.candidates += candidates.size();
+        stats.check_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - check_start).count();
+
+        if (first_passing < candidates.size()) {
+            found = next[candidates[first_passing]].script;
+            return true;
+        }
+        frontier.swap(next);
+    }
+    return false;
+}
+
+// Searches for a program that gets across every hull seen so far, and confirms it on the
+// firmware. Until one is confirmed, the hull the droid fell through is added to the known
+// ones and the search starts over
+bool synthesize(const Tape& tape, const std::string& mode, size_t max_length, size_t max_states, Springscript& found) {
+    auto start = std::chrono::steady_clock::now();
+    Firmware firmware(tape);
+
+    std::vector<Hull> hulls;
+    SearchStats stats;
+    bool confirmed = false;
+
+    while (!confirmed) {
+        Springscript script;
+        if (!search(mode, hulls, max_length, max_states, script, stats)) break;
+
+        // The search works on truth tables, run the program itself before bothering the firmware
+        auto n_sensors = mode == "RUN" ? 9 : 4;
+        for (const auto& hull : hulls) {
+            if (!crosses(hull, n_sensors, [&script](unsigned s) { return run_springscript(script, s); })) {
+                throw std::runtime_error("Synthesized program falls through a known hull");
+            }
+        }
+
+        long long int score;
+        std::string text;
+        auto run_start = std::chrono::steady_clock::now();
+        confirmed = firmware.accepts(to_string(script, mode), score, text);
+        stats.firmware_runs++;
+        stats.firmware_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+        std::cout << "  " << std::setw(2) << hulls.size() << " known hulls: "
+                  << std::setw(2) << script.size() << " instructions, "
+                  << (confirmed ? "confirmed" : "rejected") << " by the firmware" << std::endl;
+        if (confirmed) {
+            found = script;
+            break;
+        }
+
+        Hull hull;
+        if (!parse_hull(text, hull) || std::find(hulls.begin(), hulls.end(), hull) != hulls.end()) {
+            std::cout << "  The firmware rejected a program that crosses every known hull" << std::endl;
+            break;
+        }
+        hulls.push_back(hull);
+    }
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::fixed << std::setprecision(3)
+              << "  " << elapsed << "s in total, " << stats.candidates << " candidates ("
+              << std::setprecision(0) << stats.candidates / elapsed << "/s)" << std::endl
+              << "  Expanded " << stats.states << " states in " << std::setprecision(3) << stats.expand_seconds
+              << "s (" << std::setprecision(1) << stats.expand_seconds * 1e9 / std::max<uint64_t>(stats.states, 1)
+              << "ns each)" << std::endl
+              << "  Checked natively in " << stats.check_seconds * 1e9 / stats.candidates
+              << "ns each, " << stats.firmware_runs << " firmware runs took "
+              << stats.firmware_seconds * 1e6 / stats.firmware_runs << "us each" << std::endl;
+    return confirmed;
+}
+
+void synthesize_and_run(const Tape& tape, const std::string& mode, size_t max_length, size_t max_states) {
+    Springscript script;
+    if (!synthesize(tape, mode, max_length, max_states, script)) {
+        std::cout << "No program with up to " << max_length << " instructions" << std::endl;
+        return;
+    }
+    auto code = to_string(script, mode);
+    std::cout << code;
+    run_program(tape, code);
+}
+
+int main(int argc, char** argv) {
     const auto tape = read_tape_from_disk("input.txt");
 
+    // Pass --synthesize [max length] [max states per length] to search for the programs
+    // instead of using the handwritten ones. By default the states per length are as many
+    // as the search can keep within `default_search_bytes`
+    if (argc > 1 && std::string(argv[1]) == "--synthesize") {
+        const size_t default_search_bytes = 512ull << 20;
+        size_t max_length = argc > 2 ? std::stoul(argv[2]) : 15;
+        size_t max_states = argc > 3 ? std::stoul(argv[3]) : default_search_bytes / search_bytes_per_state(max_length);
+
+        std::cout << "Part 1: " << std::endl;
+        synthesize_and_run(tape, "WALK", max_length, max_states);
+
+        std::cout << "Part 2: " << std::endl;
+        synthesize_and_run(tape, "RUN", max_length, max_states);
+        return 0;
+    }
+
     std::cout << "Part 1: " << std::endl;
     part1(tape);
 
     std::cout << "Part 2: " << std::endl;
     part2(tape);
-}
\ No newline at end of file
+}
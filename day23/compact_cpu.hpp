@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A CPU small enough to keep a million of them alive at once. All CPUs running the same
+// program share one read-only `Image`; each one only owns the pages of memory it wrote to.
+// Input and output go through fixed buffers inside the object, sized for one packet of the
+// NIC protocol: the CPU stops when it needs input and its buffer is empty, or when its
+// output buffer is full. Opcodes and statuses are the ones from cpu.hpp.
+
+class Image {
+public:
+    explicit Image(const Tape& tape) {
+        size_t size = 0;
+        for (const auto& cell : tape) size = std::max(size, cell.first + 1);
+        cells.resize(size);
+        for (const auto& cell : tape) cells[cell.first] = cell.second;
+    }
+
+    long long int operator[](uint32_t addr) const { return addr < cells.size() ? cells[addr] : 0; }
+
+private:
+    std::vector<long long int> cells;
+};
+
+class CompactCPU {
+public:
+    static const uint32_t page_cells = 4;
+    static const uint8_t in_capacity = 2;
+    static const uint8_t out_capacity = 3;
+
+    // `image` has to outlive the CPU
+    explicit CompactCPU(const Image& image):
+        image(&image), n_pages(0), n_in(0), n_out(0), pc(0), relative_addr_base(0) {}
+
+    CompactCPU(CompactCPU&&) = default;
+    CompactCPU& operator=(CompactCPU&&) = default;
+
+    // False if the input buffer is full
+    bool push_input(long long int value) {
+        if (n_in == in_capacity) return false;
+        in[n_in++] = value;
+        return true;
+    }
+
+    uint8_t n_outputs() const { return n_out; }
+    long long int output(uint8_t i) const { return out[i]; }
+    void clear_outputs() { n_out = 0; }
+
+    // Runs until the program needs input and there is none (NO_INPUT), the output buffer is
+    // full (OUTPUT_FULL), or it stops
+    InstrExecStatus run() {
+        while (true) {
+            auto word = load(pc);
+            auto opcode = word % 100;
+            auto modes = word / 100;
+
+            switch (static_cast<OpCodes>(opcode)) {
+                case OpCodes::ADD:
+                    store(addr(modes, 3), load(addr(modes, 1)) + load(addr(modes, 2)));
+                    pc += 4;
+                    break;
+                case OpCodes::MULT:
+                    store(addr(modes, 3), load(addr(modes, 1)) * load(addr(modes, 2)));
+                    pc += 4;
+                    break;
+                case OpCodes::INPUT:
+                    if (n_in == 0) return InstrExecStatus::NO_INPUT;
+                    store(addr(modes, 1), in[0]);
+                    in[0] = in[1];
+                    n_in--;
+                    pc += 2;
+                    break;
+                case OpCodes::OUTPUT:
+                    if (n_out == out_capacity) return InstrExecStatus::OUTPUT_FULL;
+                    out[n_out++] = load(addr(modes, 1));
+                    pc += 2;
+                    break;
+                case OpCodes::JUMP_IF_TRUE:
+                    pc = load(addr(modes, 1)) != 0 ? load(addr(modes, 2)) : pc + 3;
+                    break;
+                case OpCodes::JUMP_IF_FALSE:
+                    pc = load(addr(modes, 1)) == 0 ? load(addr(modes, 2)) : pc + 3;
+                    break;
+                case OpCodes::LESS_THAN:
+                    store(addr(modes, 3), load(addr(modes, 1)) < load(addr(modes, 2)) ? 1 : 0);
+                    pc += 4;
+                    break;
+                case OpCodes::EQUALS:
+                    store(addr(modes, 3), load(addr(modes, 1)) == load(addr(modes, 2)) ? 1 : 0);
+                    pc += 4;
+                    break;
+                case OpCodes::SET_REL_OFFSET:
+                    relative_addr_base += load(addr(modes, 1));
+                    pc += 2;
+                    break;
+                case OpCodes::HALT: return InstrExecStatus::HALT;
+                default: return InstrExecStatus::UNKOWN_OPCODE;
+            }
+        }
+    }
+
+    // Everything this CPU takes in memory, its private pages included
+    size_t bytes() const { return sizeof(*this) + capacity(n_pages) * sizeof(Page); }
+
+private:
+    struct Page {
+        uint32_t index;
+        long long int cells[page_cells];
+    };
+
+    const Image* image;
+
+    // Pages written to so far, sorted by index, in an array of `capacity(n_pages)` pages
+    std::unique_ptr<Page[]> pages;
+    uint32_t n_pages;
+
+    uint8_t n_in, n_out;
+    uint32_t pc;
+    int32_t relative_addr_base;
+
+    long long int in[in_capacity];
+    long long int out[out_capacity];
+
+    // Up to `exact_pages` the array has room for exactly the pages in it, which is plenty for
+    // a NIC and keeps idle CPUs as small as can be. Past that it doubles whenever it's full.
+    // Either way its size follows from the number of pages, so it takes no field
+    static const uint32_t exact_pages = 16;
+
+    static uint32_t capacity(uint32_t n) {
+        if (n <= exact_pages) return n;
+        uint32_t c = exact_pages;
+        while (c < n) c *= 2;
+        return c;
+    }
+
+    Page* find_page(uint32_t index) const {
+        auto end = pages.get() + n_pages;
+        auto page = std::lower_bound(pages.get(), end, index, [](const Page& p, uint32_t i) { return p.index < i; });
+        return page != end && page->index == index ? page : nullptr;
+    }
+
+    long long int load(uint32_t addr) const {
+        auto page = find_page(addr / page_cells);
+        return page ? page->cells[addr % page_cells] : (*image)[addr];
+    }
+
+    // Copies the page from the image on its first write. Past `exact_pages`, a CPU writing all
+    // over memory doesn't copy the whole page table for every new page
+    void store(uint32_t addr, long long int value) {
+        auto index = addr / page_cells;
+        auto page = find_page(index);
+        if (!page) {
+            auto end = pages.get() + n_pages;
+            auto at = std::lower_bound(pages.get(), end, index, [](const Page& p, uint32_t i) { return p.index < i; }) - pages.get();
+
+            if (n_pages == capacity(n_pages)) {
+                std::unique_ptr<Page[]> grown(new Page[capacity(n_pages + 1)]);
+                std::copy(pages.get(), end, grown.get());
+                pages = std::move(grown);
+            }
+            std::copy_backward(pages.get() + at, pages.get() + n_pages, pages.get() + n_pages + 1);
+            n_pages++;
+
+            page = &pages[at];
+            page->index = index;
+            for (uint32_t k = 0; k < page_cells; k++) page->cells[k] = (*image)[index * page_cells + k];
+        }
+        page->cells[addr % page_cells] = value;
+    }
+
+    // Address of the `i`th parameter of the current instruction
+    uint32_t addr(long long int modes, int i) const {
+        auto mode = (i == 1 ? modes : i == 2 ? modes / 10 : modes / 100) % 10;
+        switch (static_cast<AddressingModes>(mode)) {
+            case AddressingModes::POSITION:  return load(pc + i);
+            case AddressingModes::IMMEDIATE: return pc + i;
+            default:                         return relative_addr_base + load(pc + i);
+        }
+    }
+};
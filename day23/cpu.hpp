@@ -5,11 +5,13 @@
 #include <queue>
 #include <unordered_map>
 
+#include "trace.hpp"
+
 
 using Tape = std::unordered_map<size_t,long long int>;
 
 enum class InstrExecStatus {
-    IDLE, ALL_GOOD, HALT, UNKOWN_OPCODE, NO_INPUT,
+    IDLE, ALL_GOOD, HALT, UNKOWN_OPCODE, NO_INPUT, OUTPUT_FULL,
 };
 
 enum class OpCodes {
@@ -36,7 +38,33 @@ public:
     CPU(const Tape& tape):
         tape(tape),
         pc(0),
-        relative_addr_base(0) {}
+        relative_addr_base(0),
+        instructions_executed(0),
+        state_changes(0),
+        idle_poll_mark(static_cast<uint64_t>(-1)),
+        trace(nullptr),
+        checker(nullptr),
+        trace_id(0),
+        pc_every(0),
+        next_pc_sample(no_pc_sample) {}
+
+    // Records every input consumed and output produced by this CPU (and every nth pc, if the
+    // writer samples pcs) under `id`. Pass nullptr to stop tracing
+    void set_trace(TraceWriter* writer, uint64_t id) {
+        trace = writer;
+        checker = nullptr;
+        trace_id = id;
+        sample_pc_every(writer ? writer->get_pc_every() : 0);
+    }
+
+    // Checks the same events as `set_trace` records against `trace_checker` as they happen,
+    // instead of recording them
+    void set_trace_checker(TraceChecker* trace_checker, uint64_t id) {
+        trace = nullptr;
+        checker = trace_checker;
+        trace_id = id;
+        sample_pc_every(trace_checker ? trace_checker->get_pc_every() : 0);
+    }
 
     InstrExecStatus run_program() {
         InstrExecStatus status;
@@ -45,7 +73,7 @@ public:
     }
 
     InstrExecStatus run_until_input_is_required() {
-        InstrExecStatus status;
+        InstrExecStatus status = InstrExecStatus::ALL_GOOD;
         while(peek_current_opcode() % 100 != static_cast<int>(OpCodes::INPUT)) {
             status = run_one_instruction();
             if (status != InstrExecStatus::ALL_GOOD) return status;
@@ -53,30 +81,57 @@ public:
         return status;
     }
 
+    // Feeds `idle_value` to a CPU that is waiting for input and runs it until it waits for
+    // input again, like the NIC firmware does when polled with -1. If a poll leaves the CPU
+    // exactly as it found it (same pc and relative base, no memory cell changed and nothing
+    // output), any further identical poll can't do anything either, so those return right
+    // away until something else runs the CPU
+    InstrExecStatus poll_idle(long long int idle_value) {
+        if (instructions_executed == idle_poll_mark && in.empty()) return InstrExecStatus::ALL_GOOD;
+
+        auto start_pc = pc;
+        auto start_base = relative_addr_base;
+        auto start_changes = state_changes;
+
+        in.push(idle_value);
+        run_one_instruction();
+        auto status = run_until_input_is_required();
+
+        // The consumed input itself counts as one change
+        if (pc == start_pc && relative_addr_base == start_base && state_changes == start_changes + 1)
+            idle_poll_mark = instructions_executed;
+        return status;
+    }
+
     int peek_current_opcode() {
         return tape[pc];
     }
 
     InstrExecStatus run_one_instruction() {
+        instructions_executed++;
+        if (instructions_executed == next_pc_sample) trace_pc();
+
         auto opcode = tape[pc] % 100;
         auto modes  = tape[pc] / 100;
 
         switch (static_cast<OpCodes>(opcode)) {
             case OpCodes::ADD: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] + tape[addrs[1]];
+                store(addrs[2], tape[addrs[0]] + tape[addrs[1]]);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::MULT: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] * tape[addrs[1]];
+                store(addrs[2], tape[addrs[0]] * tape[addrs[1]]);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::INPUT: {
                 auto addrs = eval_operand_addrs(1, modes, pc + 1);
-                tape[addrs[0]] = in.front();
+                store(addrs[0], in.front());
+                state_changes++;
+                if (trace || checker) trace_input(in.front());
                 in.pop();
                 pc += 2;
                 return InstrExecStatus::ALL_GOOD;
@@ -84,6 +139,8 @@ public:
             case OpCodes::OUTPUT: {
                 auto addrs = eval_operand_addrs(1, modes, pc + 1);
                 out.push(tape[addrs[0]]);
+                state_changes++;
+                if (trace || checker) trace_output(tape[addrs[0]]);
                 pc += 2;
                 return InstrExecStatus::ALL_GOOD;
             }
@@ -99,18 +156,19 @@ public:
             }
             case OpCodes::LESS_THAN: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] < tape[addrs[1]] ? 1 : 0;
+                store(addrs[2], tape[addrs[0]] < tape[addrs[1]] ? 1 : 0);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::EQUALS: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] == tape[addrs[1]] ? 1 : 0;
+                store(addrs[2], tape[addrs[0]] == tape[addrs[1]] ? 1 : 0);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::SET_REL_OFFSET: {
                 auto addrs = eval_operand_addrs(1, modes, pc + 1);
+                if (tape[addrs[0]] != 0) state_changes++;
                 relative_addr_base += tape[addrs[0]];
                 pc += 2;
                 return InstrExecStatus::ALL_GOOD;
@@ -123,6 +181,8 @@ public:
     std::queue<long long int>& get_in() { return in; }
     std::queue<long long int>& get_out() { return out; }
 
+    uint64_t get_instructions_executed() const { return instructions_executed; }
+
     void mem_dump(size_t start, size_t end) {
         for (int i = start; i < end; i++) {
             std::cout << i << ": " << tape[i] << std::endl;
@@ -137,9 +197,56 @@ private:
     // Base pointer for relative addressing
     size_t relative_addr_base;
 
+    uint64_t instructions_executed;
+
+    // Number of inputs, outputs, relative base moves and stores that changed a memory cell
+    uint64_t state_changes;
+
+    // Value of `instructions_executed` after the last poll that turned out to be a no-op
+    uint64_t idle_poll_mark;
+
+    TraceWriter* trace;
+    TraceChecker* checker;
+    uint64_t trace_id;
+
+    // Every `pc_every`th instruction, the pc is traced. `next_pc_sample` is the value of
+    // `instructions_executed` when that happens next, and stays at `no_pc_sample` if never
+    static const uint64_t no_pc_sample = static_cast<uint64_t>(-1);
+    uint64_t pc_every;
+    uint64_t next_pc_sample;
+
     std::queue<long long int> in;
     std::queue<long long int> out;
 
+    void sample_pc_every(uint64_t every) {
+        pc_every = every;
+        next_pc_sample = every ? (instructions_executed / every + 1) * every : no_pc_sample;
+    }
+
+    void trace_pc() {
+        if (trace) trace->pc(trace_id, pc);
+        if (checker) checker->pc(trace_id, pc);
+        next_pc_sample += pc_every;
+    }
+
+    void trace_input(long long int value) {
+        if (trace) trace->input(trace_id, value);
+        if (checker) checker->input(trace_id, value);
+    }
+
+    void trace_output(long long int value) {
+        if (trace) trace->output(trace_id, value);
+        if (checker) checker->output(trace_id, value);
+    }
+
+    void store(size_t addr, long long int value) {
+        auto& cell = tape[addr];
+        if (cell != value) {
+            cell = value;
+            state_changes++;
+        }
+    }
+
     int eval_operand_addr(int mode, size_t position) {
         switch (static_cast<AddressingModes>(mode)) {
             case AddressingModes::POSITION:  return tape[position];
@@ -159,7 +266,7 @@ private:
 
 Tape read_tape_from_disk(std::string filename) {
     Tape tape;
-    std::ifstream file(filename, 0);
+    std::ifstream file(filename);
 
     size_t head_pos = 0;
     std::string val;
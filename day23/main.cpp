@@ -1,9 +1,17 @@
 #include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <map>
 #include <queue>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
+#include <unistd.h>
+
 #include "cpu.hpp"
+#include "compact_cpu.hpp"
 
 struct Message {
     long long int from, to, x, y;
@@ -36,14 +44,13 @@ std::vector<Message> get_all_messages(int from, std::queue<long long int>& queue
     return ms;
 }
 
-int main() {
-    const auto tape = read_tape_from_disk("input.txt");
-
+void run_network(const Tape& tape, TraceWriter* trace) {
     const int n_cpus = 50;
 
     std::vector<CPU> cpus;
     for (int i = 0; i < n_cpus; i++) {
         CPU cpu(tape);
+        cpu.set_trace(trace, i);
         cpu.get_in().push(i);
         cpu.run_until_input_is_required();
         cpu.run_one_instruction();
@@ -62,9 +69,7 @@ int main() {
 
             if (mailbox[i].size() == 0) {
                 cpu.run_until_input_is_required();
-                cpu.get_in().push(-1);
-                cpu.run_one_instruction();
-                cpu.run_until_input_is_required();
+                cpu.poll_idle(-1);
             }
             while (mailbox[i].size() > 0) {
                 const auto& m = mailbox[i].front();
@@ -103,13 +108,230 @@ int main() {
             mailbox[0].push(nat);
             if (nat.y == last_from_nat_y) {
                 std::cout << "Part 2: " << nat.y << std::endl;
-                goto end;
+                return;
             } else {
                 last_from_nat_y = nat.y;
             }
         }
 
     }
-end:
-    return 0;
+}
+
+// Runs `cpu` until it waits for input, collecting the packets it sends into `sent`
+InstrExecStatus run_compact(CompactCPU& cpu, int from, std::vector<Message>& sent) {
+    while (true) {
+        auto status = cpu.run();
+        if (cpu.n_outputs() == CompactCPU::out_capacity) {
+            sent.push_back({from, cpu.output(0), cpu.output(1), cpu.output(2)});
+            cpu.clear_outputs();
+        }
+        if (status != InstrExecStatus::OUTPUT_FULL) return status;
+    }
+}
+
+// Same network as `run_network`, on compact CPUs
+void run_compact_network(const Tape& tape) {
+    const int n_cpus = 50;
+    const Image image(tape);
+
+    std::vector<CompactCPU> cpus;
+    std::vector<std::queue<Message>> mailbox(n_cpus);
+    std::vector<Message> sent;
+    for (int i = 0; i < n_cpus; i++) {
+        cpus.emplace_back(image);
+        cpus[i].push_input(i);
+        run_compact(cpus[i], i, sent);
+    }
+
+    Message nat{-1, -1, -1, -1};
+    long long int last_from_nat_y = -1;
+
+    while (true) {
+        for (int i = 0; i < n_cpus; i++) {
+            auto& cpu = cpus[i];
+
+            if (mailbox[i].empty()) {
+                cpu.push_input(-1);
+                run_compact(cpu, i, sent);
+            }
+            for (; !mailbox[i].empty(); mailbox[i].pop()) {
+                cpu.push_input(mailbox[i].front().x);
+                cpu.push_input(mailbox[i].front().y);
+                run_compact(cpu, i, sent);
+            }
+
+            for (const auto& m : sent) {
+                if (m.to == 255) {
+                    if (nat.from == -1) std::cout << "Part 1: " << m.y << std::endl;
+                    nat = m;
+                } else if (m.to >= 0 && m.to < n_cpus) {
+                    mailbox[m.to].push(m);
+                }
+            }
+            sent.clear();
+        }
+
+        if (std::all_of(mailbox.begin(), mailbox.end(), [](const std::queue<Message>& q) { return q.empty(); })) {
+            mailbox[0].push(nat);
+            if (nat.y == last_from_nat_y) {
+                std::cout << "Part 2: " << nat.y << std::endl;
+                return;
+            }
+            last_from_nat_y = nat.y;
+        }
+    }
+}
+
+// Resident set size of this process, 0 where /proc isn't available
+size_t resident_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Boots `n` NICs on compact CPUs and polls each one once, which leaves them all idle and
+// waiting for packets. Then does the same with a few regular CPUs, for comparison
+void run_scale(const Tape& tape, size_t n) {
+    const Image image(tape);
+    std::vector<Message> sent;
+
+    auto rss_before = resident_bytes();
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<CompactCPU> cpus;
+    cpus.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        cpus.emplace_back(image);
+        cpus[i].push_input(i % 50);
+        run_compact(cpus[i], i, sent);
+        cpus[i].push_input(-1);
+        run_compact(cpus[i], i, sent);
+        sent.clear();
+    }
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto rss_compact = resident_bytes() - rss_before;
+
+    size_t bytes = 0;
+    for (const auto& cpu : cpus) bytes += cpu.bytes();
+
+    std::cout << "Booted " << n << " compact CPUs in " << seconds * 1e3 << "ms" << std::endl
+              << "  bytes per idle CPU: " << bytes / n << " (" << sizeof(CompactCPU) << " inline), "
+              << rss_compact / n << " resident" << std::endl;
+
+    const size_t n_regular = std::min<size_t>(n, 1000);
+    rss_before = resident_bytes();
+    std::vector<CPU> regular;
+    for (size_t i = 0; i < n_regular; i++) {
+        regular.emplace_back(tape);
+        regular[i].get_in().push(i % 50);
+        regular[i].run_until_input_is_required();
+        regular[i].run_one_instruction();
+        regular[i].run_until_input_is_required();
+        regular[i].poll_idle(-1);
+        while (!regular[i].get_out().empty()) regular[i].get_out().pop();
+    }
+    std::cout << "  regular CPU, resident: " << (resident_bytes() - rss_before) / n_regular
+              << " bytes per idle CPU (over " << n_regular << ")" << std::endl;
+}
+
+// Re-drives each traced CPU with its recorded inputs only: no mailboxes, no NAT. Since a CPU
+// is deterministic given its inputs, it must reproduce the recorded outputs and pcs. Each
+// event is checked against the trace as the CPU produces it, nothing is recorded again
+bool replay(const Tape& tape, const std::string& filename) {
+    auto reader = TraceReader::read_from_disk(filename);
+
+    std::map<uint64_t,std::vector<TraceEvent>> recorded;
+    TraceEvent event;
+    while (reader.next(event)) recorded[event.cpu_id].push_back(event);
+
+    std::vector<CPU> cpus;
+    std::vector<TraceChecker> checkers;
+    checkers.reserve(recorded.size());
+    for (const auto& kv : recorded) {
+        checkers.emplace_back(kv.second, reader.get_pc_every());
+        CPU cpu(tape);
+        for (const auto& e : kv.second) {
+            if (e.kind == TraceEventKind::INPUT) cpu.get_in().push(e.value);
+        }
+        cpu.set_trace_checker(&checkers.back(), kv.first);
+        cpus.push_back(cpu);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto& cpu : cpus) {
+        while (!cpu.get_in().empty()) {
+            cpu.run_until_input_is_required();
+            cpu.run_one_instruction();
+        }
+        cpu.run_until_input_is_required();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    bool matches = true;
+    uint64_t instructions = 0;
+    size_t i = 0;
+    for (const auto& kv : recorded) {
+        if (!checkers[i].matches()) {
+            std::cout << "CPU " << kv.first << " diverged from the trace" << std::endl;
+            matches = false;
+        }
+        instructions += cpus[i].get_instructions_executed();
+        i++;
+    }
+
+    auto seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << "Replayed " << recorded.size() << " CPUs, " << instructions << " instructions in "
+              << seconds * 1e3 << "ms (" << instructions / seconds / 1e6 << " Minstr/s), "
+              << (matches ? "trace matches" : "trace does NOT match") << std::endl;
+    return matches;
+}
+
+int main(int argc, char** argv) {
+    const auto tape = read_tape_from_disk("input.txt");
+
+    std::string record_to, replay_from;
+    uint64_t pc_every = 0;
+    size_t scale = 0;
+    bool compact = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--record" && i + 1 < argc) record_to = argv[++i];
+        else if (arg == "--pc-every" && i + 1 < argc) pc_every = std::stoull(argv[++i]);
+        else if (arg == "--replay" && i + 1 < argc) replay_from = argv[++i];
+        else if (arg == "--compact") compact = true;
+        else if (arg == "--scale" && i + 1 < argc) scale = std::stoull(argv[++i]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--record FILE [--pc-every N] | --replay FILE | --compact | --scale N]" << std::endl;
+            return 2;
+        }
+    }
+
+    if (!replay_from.empty()) {
+        try {
+            return replay(tape, replay_from) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << replay_from << ": " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (compact) {
+        run_compact_network(tape);
+        return 0;
+    }
+    if (scale > 0) {
+        run_scale(tape, scale);
+        return 0;
+    }
+
+    if (record_to.empty()) {
+        run_network(tape, nullptr);
+    } else {
+        TraceWriter trace(pc_every);
+        run_network(tape, &trace);
+        trace.write_to_disk(record_to);
+        std::cout << "Wrote " << trace.bytes().size() << " bytes to " << record_to << std::endl;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Compact binary log of the I/O of one or more CPUs, and optionally of every nth pc.
+//
+// The file starts with the magic bytes "ICT1" and the pc sampling interval, followed by
+// a stream of events. Every value is a LEB128 varint, signed values are zigzag encoded
+// first, so typical events (small pcs, packet fields, -1 polls) take 2-3 bytes:
+//
+//   header = (cpu_id << 2) | kind
+//   INPUT  / OUTPUT: header, zigzag(value)
+//   PC:              header, pc
+
+enum class TraceEventKind {
+    INPUT = 0, OUTPUT = 1, PC = 2,
+};
+
+struct TraceEvent {
+    TraceEventKind kind;
+    uint64_t cpu_id;
+    long long int value;
+
+    bool operator==(const TraceEvent& other) const {
+        return kind == other.kind && cpu_id == other.cpu_id && value == other.value;
+    }
+};
+
+const std::string trace_magic = "ICT1";
+
+class TraceWriter {
+public:
+    // `pc_every` == 0 disables pc sampling
+    explicit TraceWriter(uint64_t pc_every = 0): pc_every(pc_every) {
+        buf.insert(buf.end(), trace_magic.begin(), trace_magic.end());
+        put_varint(pc_every);
+    }
+
+    void input(uint64_t cpu_id, long long int value) { put_event(TraceEventKind::INPUT, cpu_id, zigzag(value)); }
+    void output(uint64_t cpu_id, long long int value) { put_event(TraceEventKind::OUTPUT, cpu_id, zigzag(value)); }
+    void pc(uint64_t cpu_id, size_t pc) { put_event(TraceEventKind::PC, cpu_id, pc); }
+
+    uint64_t get_pc_every() const { return pc_every; }
+    const std::vector<uint8_t>& bytes() const { return buf; }
+
+    void write_to_disk(const std::string& filename) const {
+        std::ofstream file(filename, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+    }
+
+private:
+    const uint64_t pc_every;
+    std::vector<uint8_t> buf;
+
+    static uint64_t zigzag(long long int v) {
+        return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+    }
+
+    void put_varint(uint64_t v) {
+        while (v >= 0x80) {
+            buf.push_back(static_cast<uint8_t>(v) | 0x80);
+            v >>= 7;
+        }
+        buf.push_back(static_cast<uint8_t>(v));
+    }
+
+    void put_event(TraceEventKind kind, uint64_t cpu_id, uint64_t value) {
+        put_varint((cpu_id << 2) | static_cast<uint64_t>(kind));
+        put_varint(value);
+    }
+};
+
+class TraceReader {
+public:
+    explicit TraceReader(std::vector<uint8_t> bytes): buf(std::move(bytes)), pos(0) {
+        if (buf.size() < trace_magic.size() || std::string(buf.begin(), buf.begin() + trace_magic.size()) != trace_magic)
+            throw std::runtime_error("Not a trace file");
+        pos = trace_magic.size();
+        pc_every = get_varint();
+    }
+
+    static TraceReader read_from_disk(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary);
+        return TraceReader(std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+    }
+
+    uint64_t get_pc_every() const { return pc_every; }
+
+    bool next(TraceEvent& event) {
+        if (pos >= buf.size()) return false;
+        auto header = get_varint();
+        if ((header & 3) > static_cast<uint64_t>(TraceEventKind::PC)) throw std::runtime_error("Unknown trace event kind");
+        event.kind = static_cast<TraceEventKind>(header & 3);
+        event.cpu_id = header >> 2;
+        auto value = get_varint();
+        event.value = event.kind == TraceEventKind::PC ? static_cast<long long int>(value) : unzigzag(value);
+        return true;
+    }
+
+private:
+    std::vector<uint8_t> buf;
+    size_t pos;
+    uint64_t pc_every;
+
+    static long long int unzigzag(uint64_t v) {
+        return static_cast<long long int>(v >> 1) ^ -static_cast<long long int>(v & 1);
+    }
+
+    // A 64-bit value takes at most 10 bytes, the last one holding a single bit
+    uint64_t get_varint() {
+        uint64_t v = 0;
+        for (int shift = 0; pos < buf.size(); shift += 7) {
+            uint8_t byte = buf[pos++];
+            if (shift == 63 && byte > 1) throw std::runtime_error("Varint longer than 64 bits in trace");
+            v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) return v;
+        }
+        throw std::runtime_error("Truncated trace");
+    }
+};
+
+// Checks the events of one CPU against a recorded trace as they happen, so a replay doesn't
+// need to record anything to compare afterwards
+class TraceChecker {
+public:
+    TraceChecker(const std::vector<TraceEvent>& expected, uint64_t pc_every):
+        expected(&expected), pc_every(pc_every), pos(0), diverged(false) {}
+
+    void input(uint64_t cpu_id, long long int value) { check({TraceEventKind::INPUT, cpu_id, value}); }
+    void output(uint64_t cpu_id, long long int value) { check({TraceEventKind::OUTPUT, cpu_id, value}); }
+    void pc(uint64_t cpu_id, size_t pc) { check({TraceEventKind::PC, cpu_id, static_cast<long long int>(pc)}); }
+
+    uint64_t get_pc_every() const { return pc_every; }
+
+    // Whether every event so far was the expected one, and none is missing
+    bool matches() const { return !diverged && pos == expected->size(); }
+
+private:
+    const std::vector<TraceEvent>* expected;
+    const uint64_t pc_every;
+    size_t pos;
+    bool diverged;
+
+    void check(const TraceEvent& event) {
+        if (diverged) return;
+        diverged = pos == expected->size() || !((*expected)[pos] == event);
+        pos++;
+    }
+};
@@ -1,6 +1,9 @@
+#include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <sstream>
+#include <string>
 #include <vector>
 #include <queue>
 #include <unordered_map>
@@ -38,7 +41,12 @@ public:
     CPU(const Tape& tape):
         tape(tape),
         pc(0),
-        relative_addr_base(0) {}
+        relative_addr_base(0),
+        ascii_in_pos(0),
+        capturing_ascii(false),
+        tape_hash(0) {
+        for (const auto& cell : this->tape) tape_hash ^= cell_hash(cell.first, cell.second);
+    }
 
     InstrExecStatus run_program() {
         InstrExecStatus status;
@@ -50,13 +58,55 @@ public:
         InstrExecStatus status;
 
         // Run until input is required and `in` queue is empty
-        while(peek_current_opcode() % 100 != static_cast<int>(OpCodes::INPUT) || !get_in().empty()) {
+        while(peek_current_opcode() % 100 != static_cast<int>(OpCodes::INPUT) || has_pending_input()) {
             status = run_one_instruction();
             if (status != InstrExecStatus::ALL_GOOD) return status;
         }
         return status;
     }
 
+    // Queues `text` to be fed to the program one character per INPUT instruction
+    void write_ascii(const std::string& text) {
+        if (ascii_in_pos == ascii_in.size()) {
+            ascii_in.clear();
+            ascii_in_pos = 0;
+        }
+        ascii_in.append(text);
+    }
+
+    // Runs the program, collecting its ASCII output, until it outputs `delim` (included in
+    // the result), outputs a non-ASCII value (left in the regular output), halts,
+    // the program needs more input than was queued, or `max_instructions` have run.
+    // The returned buffer is overwritten by the next call
+    const std::string& read_ascii_until(
+            char delim,
+            uint64_t max_instructions = std::numeric_limits<uint64_t>::max()) {
+        ascii_out.clear();
+        capturing_ascii = true;
+        for (; max_instructions > 0; max_instructions--) {
+            auto opcode = static_cast<OpCodes>(peek_current_opcode() % 100);
+            if (opcode == OpCodes::INPUT && !has_pending_input()) break;
+
+            auto size = ascii_out.size();
+            if (run_one_instruction() != InstrExecStatus::ALL_GOOD) break;
+            if (opcode == OpCodes::OUTPUT && (ascii_out.size() == size || ascii_out.back() == delim)) break;
+        }
+        capturing_ascii = false;
+        return ascii_out;
+    }
+
+    bool is_waiting_for_input() {
+        return peek_current_opcode() % 100 == static_cast<int>(OpCodes::INPUT) && !has_pending_input();
+    }
+
+    bool is_halted() {
+        return peek_current_opcode() == static_cast<int>(OpCodes::HALT);
+    }
+
+    bool has_pending_input() const {
+        return ascii_in_pos < ascii_in.size() || !in.empty();
+    }
+
     int peek_current_opcode() {
         return tape[pc];
     }
@@ -70,27 +120,33 @@ public:
         switch (static_cast<OpCodes>(opcode)) {
             case OpCodes::ADD: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] + tape[addrs[1]];
+                store(addrs[2], tape[addrs[0]] + tape[addrs[1]]);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::MULT: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] * tape[addrs[1]];
+                store(addrs[2], tape[addrs[0]] * tape[addrs[1]]);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::INPUT: {
                 auto addrs = eval_operand_addrs(1, modes, pc + 1);
-                tape[addrs[0]] = in.front();
-                in.pop();
+                if (ascii_in_pos < ascii_in.size()) {
+                    store(addrs[0], ascii_in[ascii_in_pos++]);
+                } else {
+                    store(addrs[0], in.front());
+                    in.pop();
+                }
                 pc += 2;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::OUTPUT: {
                 auto addrs = eval_operand_addrs(1, modes, pc + 1);
                 // std::cout <<  "Put " << static_cast<char>(tape[addrs[0]]) << std::endl;
-                out.push(tape[addrs[0]]);
+                auto value = tape[addrs[0]];
+                if (capturing_ascii && value >= 0 && value < 128) ascii_out.push_back(static_cast<char>(value));
+                else out.push(value);
                 pc += 2;
                 return InstrExecStatus::ALL_GOOD;
             }
@@ -106,13 +162,13 @@ public:
             }
             case OpCodes::LESS_THAN: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] < tape[addrs[1]] ? 1 : 0;
+                store(addrs[2], tape[addrs[0]] < tape[addrs[1]] ? 1 : 0);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
             case OpCodes::EQUALS: {
                 auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] == tape[addrs[1]] ? 1 : 0;
+                store(addrs[2], tape[addrs[0]] == tape[addrs[1]] ? 1 : 0);
                 pc += 4;
                 return InstrExecStatus::ALL_GOOD;
             }
@@ -127,6 +183,37 @@ public:
         }
     }
 
+    // 64-bit hash of the whole machine state: memory, pc, relative base, and the input and
+    // output still queued. Two CPUs with the same hash can be taken to be in the same state.
+    // The memory part is kept up to date on every store, so this only costs as much as the
+    // pending I/O and the `ignored` cells, which are left out of the hash. That is for memory
+    // that doesn't tell states apart, such as scratch space the program reuses
+    uint64_t state_hash(const std::vector<size_t>& ignored = {}) const {
+        uint64_t hash = tape_hash ^ mix(pc ^ 0x7063000000000000ull) ^ mix(relative_addr_base ^ 0x7262000000000000ull);
+        for (auto addr : ignored) {
+            auto cell = tape.find(addr);
+            if (cell != tape.end()) hash ^= cell_hash(addr, cell->second);
+        }
+
+        uint64_t io = 0;
+        for (auto i = ascii_in_pos; i < ascii_in.size(); i++) io = mix(io ^ static_cast<uint64_t>(ascii_in[i]));
+        io = queue_hash(in, io);
+        hash ^= mix(io ^ 0x696e000000000000ull);
+        return hash ^ mix(queue_hash(out, 0) ^ 0x6f75000000000000ull);
+    }
+
+    // Addresses of the cells holding different values in `other`, in no particular order
+    std::vector<size_t> changed_cells(const CPU& other) const {
+        std::vector<size_t> changed;
+        for (const auto& cell : tape) {
+            if (cell.second != other.load(cell.first)) changed.push_back(cell.first);
+        }
+        for (const auto& cell : other.tape) {
+            if (cell.second != 0 && tape.count(cell.first) == 0) changed.push_back(cell.first);
+        }
+        return changed;
+    }
+
     std::queue<long long int>& get_in() { return in; }
     std::queue<long long int>& get_out() { return out; }
 
@@ -147,6 +234,53 @@ private:
     std::queue<long long int> in;
     std::queue<long long int> out;
 
+    // Text queued with `write_ascii`. It is fed to INPUT instructions before anything in `in`
+    std::string ascii_in;
+    size_t ascii_in_pos;
+
+    // Text collected by `read_ascii_until`. Reused between calls
+    std::string ascii_out;
+    bool capturing_ascii;
+
+    // XOR of `cell_hash` over all of memory
+    uint64_t tape_hash;
+
+    // Finalizer of splitmix64
+    static uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    // Zero for cells holding zero, so cells that were never written don't need hashing
+    static uint64_t cell_hash(size_t addr, long long int value) {
+        return value == 0 ? 0 : mix(mix(addr) ^ static_cast<uint64_t>(value));
+    }
+
+    // Gives access to the container under a queue, so it can be hashed without a copy
+    struct QueueItems : std::queue<long long int> {
+        static const container_type& of(const std::queue<long long int>& q) {
+            return q.*&QueueItems::c;
+        }
+    };
+
+    static uint64_t queue_hash(const std::queue<long long int>& q, uint64_t hash) {
+        for (auto value : QueueItems::of(q)) hash = mix(hash ^ static_cast<uint64_t>(value));
+        return hash;
+    }
+
+    long long int load(size_t addr) const {
+        auto cell = tape.find(addr);
+        return cell == tape.end() ? 0 : cell->second;
+    }
+
+    void store(size_t addr, long long int value) {
+        auto& cell = tape[addr];
+        if (cell == value) return;
+        tape_hash ^= cell_hash(addr, cell) ^ cell_hash(addr, value);
+        cell = value;
+    }
+
     int eval_operand_addr(int mode, size_t position) {
         switch (static_cast<AddressingModes>(mode)) {
             case AddressingModes::POSITION:  return tape[position];
@@ -166,7 +300,7 @@ private:
 
 Tape read_tape_from_disk(std::string filename) {
     Tape tape;
-    std::ifstream file(filename, 0);
+    std::ifstream file(filename);
 
     size_t head_pos = 0;
     std::string val;
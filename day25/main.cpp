@@ -1,10 +1,17 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
-#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "cpu.hpp"
+#include "../intcode/parallel.hpp"
 
 enum Step {
     N, E, S, W
@@ -27,29 +34,182 @@ const std::unordered_map<Step,std::string,StepHash> step_label{
 
 using steps_t = std::vector<Step>;
 
-const std::unordered_map<std::string,steps_t> items{
-    {"bowl of rice", {E,N,W}},
-    {"fuel cell", {E,N,N,W,S,S}},
-    {"ornament", {E,N,N,W}},
-    {"planetoid", {E,N,N}},
-    {"cake", {E,N,N,E}},
-    {"astrolabe", {E,N,N,E,S,W,N}},
-    {"shell", {E,E,E}},
-    {"monolith", {E,E,S}},
-    // {"infinite loop", {E,N,N,W,S}},
-    // {"molten lava", {E,N,N,W,W}},
-    // {"escape pod", {E,N,N,E,W}},
-    // {"photons", {E,N,N,E,S,W}},
-    // {"giant electromagnet", {E,N,N,E,S,W,W}},
+const std::unordered_map<std::string,Step> label_step{
+    {"north",N}, {"south",S}, {"east",E}, {"west",W}
 };
 
-const steps_t checkpoint_path{E,N,N,E,S,W,N,W};
+// Enough for any command, including walking into the security checkpoint. Only the
+// "infinite loop" item ever gets anywhere near it
+const uint64_t command_budget = 1000000;
+
+struct Room {
+    std::string name;
+    std::vector<Step> doors;
+    std::vector<std::string> items;
+};
+
+// Far more than the ship has rooms. Going past it means the room descriptions aren't
+// parsed as expected, rather than a bigger ship
+const size_t max_states = 10000;
+
+struct RoomNode {
+    CPU cpu;
+    steps_t path;
+    Room room;
+};
+
+struct Item {
+    std::string name;
+    steps_t path;
+};
+
+// What the crawler learns about the ship
+struct ShipMap {
+    std::vector<Item> safe_items;
+    std::vector<std::string> unsafe_items;
+    steps_t checkpoint_path;
+    Step floor_direction = N;
+    size_t states = 0;
+};
+
+// Parses the description of the last room in `text`. When the droid is ejected from the
+// pressure-sensitive floor, the text describes both the floor and the checkpoint
+Room parse_room(const std::string& text) {
+    Room room;
+
+    auto header = text.rfind("== ");
+    if (header == std::string::npos) return room;
+
+    std::istringstream lines(text.substr(header));
+    std::string line;
+    std::getline(lines, line);
+    room.name = line.substr(3, line.size() - 6);
+
+    std::vector<std::string>* list = nullptr;
+    std::vector<std::string> doors;
+    while (std::getline(lines, line)) {
+        if (line == "Doors here lead:") list = &doors;
+        else if (line == "Items here:") list = &room.items;
+        else if (line.size() > 2 && line[0] == '-' && list) list->push_back(line.substr(2));
+        else list = nullptr;
+    }
+    for (const auto& door : doors) room.doors.push_back(label_step.at(door));
+    return room;
+}
 
 void push_word(CPU& cpu, const std::string& word) {
-    for (auto c : word) {
-        cpu.get_in().push(c);
+    cpu.write_ascii(word);
+    cpu.write_ascii("\n");
+}
+
+// Takes `item` on a fork of the room's CPU and checks that the droid survives it: the game
+// doesn't end, the program doesn't get stuck, and the droid can still move
+bool is_safe_item(const RoomNode& node, const std::string& item) {
+    CPU cpu(node.cpu);
+    push_word(cpu, "take " + item);
+    cpu.read_ascii_until('\0', command_budget);
+    if (!cpu.is_waiting_for_input()) return false;
+
+    push_word(cpu, step_label.at(node.room.doors.front()));
+    const auto& output = cpu.read_ascii_until('\0', command_budget);
+    return cpu.is_waiting_for_input() && output.find("can't move") == std::string::npos;
+}
+
+// The cells the game changes when the droid walks out of the start room and back, such as
+// the last command typed and the stack. Left out of the machine hash, they would make the
+// same room look like a new state depending on the way the droid came in
+std::vector<size_t> scratch_cells(const CPU& start, const Room& start_room) {
+    std::vector<size_t> scratch;
+    for (auto door : start_room.doors) {
+        CPU cpu(start);
+        push_word(cpu, step_label.at(door));
+        push_word(cpu, step_label.at(inv_step.at(door)));
+        cpu.read_ascii_until('\0', 2 * command_budget);
+
+        auto changed = cpu.changed_cells(start);
+        scratch.insert(scratch.end(), changed.begin(), changed.end());
     }
-    cpu.get_in().push('\n');
+    std::sort(scratch.begin(), scratch.end());
+    scratch.erase(std::unique(scratch.begin(), scratch.end()), scratch.end());
+    return scratch;
+}
+
+// Explores the game's states breadth first, one level at a time. Every state is reached on
+// its own fork of the CPU, and all the moves out of a level are tried in parallel. States
+// are told apart by the hash of the whole machine but its `scratch_cells`, and there can be
+// at most `max_states` of them. Then every
+// item is tested in parallel, on a fork of the CPU in the first state found in the room
+// where it lies
+ShipMap crawl(const Tape& tape) {
+    ShipMap ship;
+
+    CPU start(tape);
+    auto start_room = parse_room(start.read_ascii_until('\0'));
+
+    auto scratch = scratch_cells(start, start_room);
+    std::vector<RoomNode> rooms{{start, {}, start_room}};
+    std::unordered_set<uint64_t> visited{start.state_hash(scratch)};
+    std::unordered_set<std::string> room_names{start_room.name};
+    std::vector<size_t> first_in_room{0};
+    bool found_floor = false;
+
+    for (size_t level_begin = 0, level_end = 1; level_begin < level_end; ) {
+        std::vector<std::pair<size_t,Step>> moves;
+        for (auto i = level_begin; i < level_end; i++) {
+            for (auto door : rooms[i].room.doors) moves.push_back({i, door});
+        }
+
+        std::vector<std::pair<CPU,std::string>> results(moves.size(), {start, ""});
+        parallel_for(moves.size(), [&](size_t m) {
+            CPU cpu(rooms[moves[m].first].cpu);
+            push_word(cpu, step_label.at(moves[m].second));
+            results[m] = {cpu, cpu.read_ascii_until('\0', command_budget)};
+        });
+
+        for (size_t m = 0; m < moves.size(); m++) {
+            const auto& from = rooms[moves[m].first];
+            auto room = parse_room(results[m].second);
+
+            // Walking onto the pressure-sensitive floor without the right weight throws
+            // the droid back into the checkpoint
+            if (results[m].second.find("ejected back to the checkpoint") != std::string::npos) {
+                if (found_floor) continue;
+                found_floor = true;
+                ship.checkpoint_path = from.path;
+                ship.floor_direction = moves[m].second;
+                continue;
+            }
+            if (room.name.empty() || !visited.insert(results[m].first.state_hash(scratch)).second) continue;
+            if (rooms.size() == max_states) {
+                throw std::runtime_error("Crawled " + std::to_string(max_states) + " states without running out of new ones");
+            }
+
+            auto path = from.path;
+            path.push_back(moves[m].second);
+            if (room_names.insert(room.name).second) first_in_room.push_back(rooms.size());
+            rooms.push_back({results[m].first, path, room});
+        }
+
+        level_begin = level_end;
+        level_end = rooms.size();
+    }
+    ship.states = rooms.size();
+
+    std::vector<std::pair<size_t,std::string>> found;
+    for (auto i : first_in_room) {
+        for (const auto& item : rooms[i].room.items) found.push_back({i, item});
+    }
+
+    std::vector<char> safe(found.size());
+    parallel_for(found.size(), [&](size_t i) {
+        safe[i] = is_safe_item(rooms[found[i].first], found[i].second);
+    });
+
+    for (size_t i = 0; i < found.size(); i++) {
+        if (safe[i]) ship.safe_items.push_back({found[i].second, rooms[found[i].first].path});
+        else ship.unsafe_items.push_back(found[i].second);
+    }
+    return ship;
 }
 
 void pick_item(CPU& cpu, const std::string& item, const steps_t& steps) {
@@ -63,21 +223,63 @@ void pick_item(CPU& cpu, const std::string& item, const steps_t& steps) {
 }
 
 
-template <typename T>
-std::vector<std::vector<T>> all_combinations(std::vector<T> elems) {
-    if (elems.empty()) return {{}};
+uint64_t gray_code(uint64_t i) {
+    return i ^ (i >> 1);
+}
+
+// Searches the item subsets with indices [begin, end) in Gray code order, on a CPU standing
+// in the checkpoint and holding all `items`. Subset `i` holds every item except the ones set
+// in gray_code(i), so consecutive subsets differ by a single `take` or `drop`, followed by
+// one attempt to walk onto the floor. Returns the game's final message, or an empty string
+// if no subset in the range gets the droid through (or another shard got there first)
+std::string search_items(CPU cpu, const std::vector<std::string>& items, Step floor,
+                         uint64_t begin, uint64_t end, std::atomic<bool>& found) {
+    const auto& floor_label = step_label.at(floor);
+
+    // Get to the first subset of the range
+    for (size_t bit = 0; bit < items.size(); bit++) {
+        if (gray_code(begin) & (1ull << bit)) push_word(cpu, "drop " + items[bit]);
+    }
+
+    for (auto i = begin; i < end && !found; i++) {
+        if (i > begin) {
+            // Going from i - 1 to i flips the lowest set bit of i
+            size_t bit = 0;
+            while (((i >> bit) & 1) == 0) bit++;
+            push_word(cpu, ((gray_code(i) >> bit) & 1 ? "drop " : "take ") + items[bit]);
+        }
+
+        push_word(cpu, floor_label);
+        const auto& output = cpu.read_ascii_until('\0');
+
+        // If the current output does not contain the string "ejected", it hopefully means
+        // that we found the right combination of items
+        if (output.find("ejected") == std::string::npos) {
+            found = true;
+            return output;
+        }
+    }
+    return "";
+}
 
-    std::vector<std::vector<T>> res;
+// Splits the 2^n subsets into one contiguous Gray code range per core, each searched on
+// its own fork of the CPU
+std::string search_items_in_parallel(const CPU& cpu, const std::vector<std::string>& items, Step floor) {
+    const uint64_t n_subsets = 1ull << items.size();
+    const uint64_t n_shards = std::min<uint64_t>(n_subsets, std::max(1u, std::thread::hardware_concurrency()));
 
-    auto head = elems.back();
-    elems.pop_back();
+    std::atomic<bool> found(false);
+    std::vector<std::string> results(n_shards);
+    parallel_for(n_shards, [&](size_t shard) {
+        results[shard] = search_items(
+            cpu, items, floor, n_subsets * shard / n_shards, n_subsets * (shard + 1) / n_shards, found
+        );
+    });
 
-    for (auto sub : all_combinations(elems)) {
-        res.push_back(sub);
-        sub.push_back(head);
-        res.push_back(sub);
+    for (const auto& result : results) {
+        if (!result.empty()) return result;
     }
-    return res;
+    return "";
 }
 
 void part1() {
@@ -85,56 +287,40 @@ void part1() {
 
     // disassemble(tape, 1424);
 
+    auto crawl_start = std::chrono::steady_clock::now();
+    auto ship = crawl(tape);
+    auto crawl_end = std::chrono::steady_clock::now();
+
+    std::cout << "Crawled the ship (" << ship.states << " states) in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(crawl_end - crawl_start).count()
+              << "ms. Safe items: " << ship.safe_items.size()
+              << ", unsafe items: " << ship.unsafe_items.size() << std::endl;
+
     CPU cpu(tape);
+    cpu.read_ascii_until('\0');
 
-    auto all_items = std::accumulate(
-        items.begin(),
-        items.end(),
-        std::vector<std::string>(),
-        [](std::vector<std::string> acc, const std::pair<std::string,steps_t>& kv) { acc.push_back(kv.first); return acc; }
-    );
+    std::vector<std::string> all_items;
+    for (const auto& item : ship.safe_items) all_items.push_back(item.name);
 
     // Pick all items and move to checkpoint
-    for (const auto& item : all_items) {
-        pick_item(cpu, item, items.at(item));
+    for (const auto& item : ship.safe_items) {
+        pick_item(cpu, item.name, item.path);
     }
 
-    for (auto& w : checkpoint_path) {
+    for (auto& w : ship.checkpoint_path) {
         push_word(cpu, step_label.at(w));
     }
 
-    cpu.run_until_more_input_is_required();
-    while (!cpu.get_out().empty()) {
-        cpu.get_out().pop();
-    }
-
-    // Try all possible combinations of items to drop
-    for (const auto& comb : all_combinations(all_items)) {
-        CPU cpu_copy(cpu);
-
-        for (const auto& item : comb) {
-            push_word(cpu_copy, "drop " + item);
-        }
-        push_word(cpu_copy, "north");
-
-        cpu_copy.run_until_more_input_is_required();
+    cpu.read_ascii_until('\0');
 
-        // One of these outputs will not say
-        std::string output;
-        while (!cpu_copy.get_out().empty()) {
-            output.push_back(cpu_copy.get_out().front());
-            cpu_copy.get_out().pop();
-        }
-
-        // If the current output does not contain the string "ejected", it hopefully means
-        // that we found the right combination of items
-        if (output.find("ejected") == std::string::npos) {
-            std::cout << output << std::endl;
-            break;
-        }
-    }
+    std::cout << search_items_in_parallel(cpu, all_items, ship.floor_direction) << std::endl;
 }
 
 int main() {
-    part1();
+    try {
+        part1();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
 }
\ No newline at end of file
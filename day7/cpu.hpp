@@ -1,4 +1,6 @@
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <fstream>
 #include <sstream>
 #include <vector>
@@ -7,7 +9,16 @@
 using Tape = std::vector<int>;
 
 enum class InstrExecStatus {
-    IDLE, ALL_GOOD, HALT, UNKOWN_OPCODE
+    IDLE, ALL_GOOD, HALT, UNKOWN_OPCODE, NO_INPUT, OUTPUT, OUT_OF_BUDGET,
+};
+
+// Events `CPU::run_until` stops on, besides the program halting. Combine them with |
+enum StopMask : unsigned {
+    // Before an INPUT instruction, if there is no input to read
+    STOP_ON_INPUT  = 1 << 0,
+
+    // After the nth OUTPUT instruction
+    STOP_ON_OUTPUT = 1 << 1,
 };
 
 class CPU {
@@ -15,19 +26,56 @@ public:
     CPU(const Tape& tape, std::istream& in, std::ostream& out): tape(tape), pc(0), in(in), out(out) {}
 
     InstrExecStatus run_program() {
-        InstrExecStatus status;
-        while((status = run_one_instruction()) == InstrExecStatus::ALL_GOOD);
-        return status;
+        return run_until(0);
     }
 
-    int peek_current_opcode() {
-        return tape[pc];
+    // Runs until the program halts, stops on one of the `stop` events, or `budget`
+    // instructions ran. Each instruction word is fetched once, and events are only checked
+    // for the INPUT and OUTPUT instructions
+    InstrExecStatus run_until(unsigned stop, uint64_t n = 1,
+                              uint64_t budget = std::numeric_limits<uint64_t>::max()) {
+        uint64_t outputs = 0;
+        for (; budget > 0; budget--) {
+            auto instr = tape[pc];
+            auto opcode = instr % 100;
+            if (opcode == 3 && (stop & STOP_ON_INPUT) && !has_pending_input()) {
+                return InstrExecStatus::NO_INPUT;
+            }
+
+            auto status = execute(opcode, instr / 100);
+            if (status != InstrExecStatus::ALL_GOOD) return status;
+            if (opcode == 4 && (stop & STOP_ON_OUTPUT) && ++outputs == n) {
+                return InstrExecStatus::OUTPUT;
+            }
+        }
+        return InstrExecStatus::OUT_OF_BUDGET;
     }
 
     InstrExecStatus run_one_instruction() {
-        auto opcode = tape[pc] % 100;
-        auto modes  = tape[pc] / 100;
+        auto instr = tape[pc];
+        return execute(instr % 100, instr / 100);
+    }
+
+    // Whether there's a value to read. Skips the whitespace left after the previous value,
+    // and only blocks if the stream itself does (e.g. std::cin on a terminal)
+    bool has_pending_input() {
+        in >> std::ws;
+        bool pending = in.peek() != std::char_traits<char>::eof();
+        in.clear();
+        return pending;
+    }
+
+    int peek_current_opcode() {
+        return tape[pc];
+    }
 
+    void mem_dump() const {
+        for (int i = 0; i < tape.size(); i++) {
+            std::cout << i << ": " << tape[i] << std::endl;
+        }
+    }
+private:
+    InstrExecStatus execute(long long int opcode, long long int modes) {
         switch (opcode) {
             case 1: {
                 auto operands = eval_operands(2, modes, pc + 1);
@@ -81,12 +129,6 @@ public:
         }
     }
 
-    void mem_dump() const {
-        for (int i = 0; i < tape.size(); i++) {
-            std::cout << i << ": " << tape[i] << std::endl;
-        }
-    }
-private:
     Tape tape;
 
     // Program counter
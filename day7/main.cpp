@@ -1,20 +1,19 @@
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 #include "cpu.hpp"
 
-InstrExecStatus run_until_output_is_produced_or_halt(CPU &cpu) {
-    while(cpu.peek_current_opcode() != 4) {
-        if(cpu.run_one_instruction() == InstrExecStatus::HALT)
-            return InstrExecStatus::HALT;
-    }
-    // Execute the output instruction we just found
-    return cpu.run_one_instruction();
-}
-
 struct Amplifier {
     Amplifier(const int phase, CPU cpu): phase(phase), cpu(cpu), has_read_phase(false) {}
     const int phase;
@@ -58,7 +57,7 @@ Result run_array_of_amplifiers(
 
             out << input << std::endl;
 
-            status = run_until_output_is_produced_or_halt(amp.cpu);
+            status = amp.cpu.run_until(STOP_ON_OUTPUT);
 
             // Pick up the current amplifier's output into the `input` variable to be fed
             // to the next amplifier
@@ -70,7 +69,178 @@ Result run_array_of_amplifiers(
     return Result(input, status);
 }
 
-int get_max_output_for_permutation(std::vector<int>& phases, const Tape& tape) {
+// Timing of the feedback loop. One iteration is one value going all the way around
+// the array of amplifiers (i.e. one output of the last amplifier). `elapsed` is the wall
+// time of the whole loop, `latency` the sum over iterations of the time from the value
+// entering the first amplifier to it leaving the last one
+struct LoopStats {
+    size_t iterations = 0;
+    std::chrono::nanoseconds elapsed{0};
+    std::chrono::nanoseconds latency{0};
+
+    LoopStats& operator+=(const LoopStats& other) {
+        iterations += other.iterations;
+        elapsed += other.elapsed;
+        latency += other.latency;
+        return *this;
+    }
+};
+
+void print_loop_stats(const std::string& label, const LoopStats& stats) {
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(stats.elapsed).count();
+    auto seconds = std::chrono::duration<double>(stats.elapsed).count();
+    auto latency_us = std::chrono::duration<double, std::micro>(stats.latency).count();
+
+    std::cout << label << ": "
+              << stats.iterations << " loop iterations in " << elapsed_us << "us, "
+              << "throughput " << (seconds > 0 ? stats.iterations / seconds : 0) << " iterations/s, "
+              << "latency " << (stats.iterations > 0 ? latency_us / stats.iterations : 0)
+              << "us from amplifier A to E on average" << std::endl;
+}
+
+// Bounded blocking FIFO connecting the output of one amplifier to the input of the next one.
+// Once closed, pushes are dropped and pops drain what is left, so nobody waits for ever on
+// an amplifier that stopped
+template <typename T>
+class Channel {
+public:
+    explicit Channel(size_t capacity): capacity(capacity), closed(false) {}
+
+    // False if the channel is closed
+    bool push(T value) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this]() { return closed || queue.size() < capacity; });
+        if (closed) return false;
+        queue.push_back(value);
+        not_empty.notify_one();
+        return true;
+    }
+
+    // False once the channel is closed and empty
+    bool pop(T& value) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this]() { return closed || !queue.empty(); });
+        if (queue.empty()) return false;
+        value = queue.front();
+        queue.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+private:
+    const size_t capacity;
+    std::deque<T> queue;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+};
+
+// Runs each amplifier on its own thread. Amplifier `i` reads from `channels[i]` and writes to
+// `channels[i + 1]`, and the last amplifier writes back to `channels[0]`, closing the loop
+Result run_pipelined_amplifiers(const std::vector<int>& phases, const Tape& tape, LoopStats& stats) {
+    const size_t n = phases.size();
+
+    // Every amplifier consumes a value before producing the next one, so there are never
+    // more than a couple of values in flight per channel
+    std::vector<std::unique_ptr<Channel<int>>> channels;
+    for (size_t i = 0; i < n; i++) {
+        channels.emplace_back(new Channel<int>(4));
+        channels[i]->push(phases[i]);
+    }
+    channels[0]->push(0);
+
+    int last_output = 0;
+    size_t iterations = 0;
+
+    // Only one value goes around the loop at a time, so the first amplifier stamps the time
+    // it reads each one and the last amplifier measures from there when it outputs it. The
+    // channels order the two threads' accesses
+    std::chrono::steady_clock::time_point entered;
+    std::chrono::nanoseconds latency{0};
+    std::vector<std::exception_ptr> errors(n);
+
+    auto run_stage = [&](size_t i) {
+        Channel<int>& input = *channels[i];
+        Channel<int>& output = *channels[(i + 1) % n];
+
+        try {
+            // Private I/O buffer for this amplifier's CPU
+            std::stringbuf buf;
+            std::istream in(&buf);
+            std::ostream out(&buf);
+            CPU cpu(tape, in, out);
+
+            bool running = true;
+            while (running) {
+                switch (cpu.run_until(STOP_ON_INPUT | STOP_ON_OUTPUT)) {
+                    case InstrExecStatus::NO_INPUT: {
+                        int value;
+                        running = input.pop(value);
+                        if (!running) break;
+                        if (i == 0) entered = std::chrono::steady_clock::now();
+                        out << value << std::endl;
+                        break;
+                    }
+                    case InstrExecStatus::OUTPUT: {
+                        int value;
+                        in >> value;
+                        if (i == n - 1) {
+                            last_output = value;
+                            iterations++;
+                            latency += std::chrono::steady_clock::now() - entered;
+                        }
+                        running = output.push(value);
+                        break;
+                    }
+                    default: running = false;
+                }
+            }
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+
+        // Whatever stopped this amplifier, its neighbours must not wait for it
+        input.close();
+        output.close();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < n; i++) threads.emplace_back(run_stage, i);
+    for (auto& thread : threads) thread.join();
+
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+
+    stats.elapsed += std::chrono::steady_clock::now() - start;
+    stats.iterations += iterations;
+    stats.latency += latency;
+
+    return Result(last_output, InstrExecStatus::HALT);
+}
+
+int get_max_output_for_permutation_pipelined(std::vector<int>& phases, const Tape& tape, LoopStats& stats) {
+    int max = std::numeric_limits<int>::min();
+
+    do {
+        auto result = run_pipelined_amplifiers(phases, tape, stats);
+        max = result.output > max ? result.output : max;
+    } while (std::next_permutation(phases.begin(), phases.end()));
+
+    return max;
+}
+
+int get_max_output_for_permutation(std::vector<int>& phases, const Tape& tape, LoopStats& stats) {
 
     // I/O channels for connecting inputs and outputs of the amplifiers
     std::stringbuf buf;
@@ -87,8 +257,18 @@ int get_max_output_for_permutation(std::vector<int>& phases, const Tape& tape) {
 
             auto result = Result(0, InstrExecStatus::IDLE);
 
-            while (result.status != InstrExecStatus::HALT)
+            auto start = std::chrono::steady_clock::now();
+
+            while (result.status != InstrExecStatus::HALT) {
+                auto entered = std::chrono::steady_clock::now();
                 result = run_array_of_amplifiers(amplifiers, result.output, in, out);
+                if (result.status != InstrExecStatus::HALT) {
+                    stats.iterations++;
+                    stats.latency += std::chrono::steady_clock::now() - entered;
+                }
+            }
+
+            stats.elapsed += std::chrono::steady_clock::now() - start;
 
             max = result.output > max ? result.output : max;
 
@@ -101,10 +281,21 @@ int main() {
     const Tape tape = read_tape_from_disk("input.txt");
 
     // Part 1
+    LoopStats stats1;
     std::vector<int> phases1{0, 1, 2, 3, 4};
-    std::cout << "Part 1: " << get_max_output_for_permutation(phases1, tape) << std::endl;
+    std::cout << "Part 1: " << get_max_output_for_permutation(phases1, tape, stats1) << std::endl;
 
     // Part 2
+    LoopStats sequential_stats;
     std::vector<int> phases2{5, 6, 7, 8, 9};
-    std::cout << "Part 2: " << get_max_output_for_permutation(phases2, tape) << std::endl;
+    std::cout << "Part 2: " << get_max_output_for_permutation(phases2, tape, sequential_stats) << std::endl;
+
+    // Part 2 again, with each amplifier running on its own thread
+    LoopStats pipelined_stats;
+    std::vector<int> phases3{5, 6, 7, 8, 9};
+    std::cout << "Part 2 (pipelined): "
+              << get_max_output_for_permutation_pipelined(phases3, tape, pipelined_stats) << std::endl;
+
+    print_loop_stats("Sequential", sequential_stats);
+    print_loop_stats("Pipelined", pipelined_stats);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <type_traits>
 #include <vector>
 #include <unordered_map>
 
@@ -8,7 +9,7 @@
 using Tape = std::unordered_map<size_t,long int>;
 
 enum class InstrExecStatus {
-    IDLE, ALL_GOOD, HALT, UNKOWN_OPCODE
+    IDLE, ALL_GOOD, HALT, UNKOWN_OPCODE, NO_INPUT,
 };
 
 enum class OpCodes {
@@ -30,14 +31,18 @@ enum class AddressingModes {
     RELATIVE  = 2,
 };
 
-class CPU {
+// `In` and `Out` are anything that reads and writes integers with `>>` and `<<` like the
+// standard streams do, such as the buffered `FastReader` and `FastWriter` (see stream.hpp)
+template <typename In = std::istream, typename Out = std::ostream>
+class BasicCPU {
 public:
-    CPU(const Tape& tape, std::istream& in, std::ostream& out):
+    BasicCPU(const Tape& tape, In& in, Out& out):
         tape(tape),
         pc(0),
         relative_addr_base(0),
         in(in),
-        out(out) {}
+        out(out),
+        handlers(handler_table()) {}
 
     InstrExecStatus run_program() {
         InstrExecStatus status;
@@ -45,111 +50,165 @@ public:
         return status;
     }
 
+    // Same as `run_program`, but calls `probe.before(opcode)` and `probe.after(opcode)`
+    // around each instruction (see perf.hpp)
+    template <typename Probe>
+    InstrExecStatus run_program(Probe& probe) {
+        InstrExecStatus status;
+        do {
+            auto opcode = peek_current_opcode();
+            probe.before(opcode);
+            status = run_one_instruction();
+            probe.after(opcode);
+        } while(status == InstrExecStatus::ALL_GOOD);
+        return status;
+    }
+
     int peek_current_opcode() {
         return tape[pc];
     }
 
+    // One table lookup on the raw instruction word picks a handler compiled for its opcode
+    // and addressing modes, so no mode digit gets decoded while running
     InstrExecStatus run_one_instruction() {
-        auto opcode = tape[pc] % 100;
-        auto modes  = tape[pc] / 100;
-
-        switch (static_cast<OpCodes>(opcode)) {
-            case OpCodes::ADD: {
-                auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] + tape[addrs[1]];
-                pc += 4;
+        return handlers[handler_index(tape[pc])](*this);
+    }
+
+    void mem_dump(size_t start, size_t end) {
+        for (int i = start; i < end; i++) {
+            std::cout << i << ": " << tape[i] << std::endl;
+        }
+    }
+private:
+    Tape tape;
+
+    // Program counter
+    size_t pc;
+
+    // Base pointer for relative addressing
+    size_t relative_addr_base;
+
+    In &in;
+    Out &out;
+
+    using handler_t = InstrExecStatus (*)(BasicCPU&);
+
+    // Instruction words with three mode digits, each one from 0 to 2, are below 22300
+    static const size_t n_handlers = 22300;
+
+    const handler_t* handlers;
+
+    // Larger words are only valid with extra mode digits the instruction doesn't use, which
+    // are dropped. Slot 0 is for unknown opcodes
+    static size_t handler_index(long int word) {
+        if (word >= 0 && static_cast<size_t>(word) < n_handlers) return word;
+        if (word < 0) return 0;
+
+        auto index = drop_unused_modes(word);
+        return index < n_handlers ? index : 0;
+    }
+
+    // The instruction word without the mode digits of parameters the opcode doesn't have,
+    // which the decoder always ignored
+    static size_t drop_unused_modes(long int word) {
+        auto opcode = word % 100;
+        long int digits = opcode == 99 ? 100
+                        : opcode == 3 || opcode == 4 || opcode == 9 ? 1000
+                        : opcode == 5 || opcode == 6 ? 10000 : 100000;
+        return static_cast<size_t>(word % digits);
+    }
+
+    template <int Mode>
+    size_t addr(size_t position) {
+        return Mode == static_cast<int>(AddressingModes::POSITION)  ? tape[position]
+             : Mode == static_cast<int>(AddressingModes::IMMEDIATE) ? position
+             : relative_addr_base + tape[position];
+    }
+
+    template <int Op, int M1, int M2, int M3>
+    static InstrExecStatus execute(BasicCPU& cpu) {
+        auto& tape = cpu.tape;
+        auto pc = cpu.pc;
+
+        switch (static_cast<OpCodes>(Op)) {
+            case OpCodes::ADD:
+                tape[cpu.template addr<M3>(pc + 3)] = tape[cpu.template addr<M1>(pc + 1)] + tape[cpu.template addr<M2>(pc + 2)];
+                cpu.pc += 4;
                 return InstrExecStatus::ALL_GOOD;
-            }
-            case OpCodes::MULT: {
-                auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] * tape[addrs[1]];
-                pc += 4;
+            case OpCodes::MULT:
+                tape[cpu.template addr<M3>(pc + 3)] = tape[cpu.template addr<M1>(pc + 1)] * tape[cpu.template addr<M2>(pc + 2)];
+                cpu.pc += 4;
                 return InstrExecStatus::ALL_GOOD;
-            }
             case OpCodes::INPUT: {
-                int n;
-                auto addrs = eval_operand_addrs(1, modes, pc + 1);
-                in >> n;
-                tape[addrs[0]] = n;
-                pc += 2;
+                long long int n;
+                if (!(cpu.in >> n)) return InstrExecStatus::NO_INPUT;
+                tape[cpu.template addr<M1>(pc + 1)] = n;
+                cpu.pc += 2;
                 return InstrExecStatus::ALL_GOOD;
             }
-            case OpCodes::OUTPUT: {
-                auto addrs = eval_operand_addrs(1, modes, pc + 1);
-                out << tape[addrs[0]] << std::endl;
-                pc += 2;
+            case OpCodes::OUTPUT:
+                // No flush: reading from std::cin flushes std::cout before waiting anyway
+                cpu.out << tape[cpu.template addr<M1>(pc + 1)] << '\n';
+                cpu.pc += 2;
                 return InstrExecStatus::ALL_GOOD;
-            }
-            case OpCodes::JUMP_IF_TRUE: {
-                auto addrs = eval_operand_addrs(2, modes, pc + 1);
-                pc = tape[addrs[0]] != 0 ? tape[addrs[1]] : pc + 3;
+            case OpCodes::JUMP_IF_TRUE:
+                cpu.pc = tape[cpu.template addr<M1>(pc + 1)] != 0 ? tape[cpu.template addr<M2>(pc + 2)] : pc + 3;
                 return InstrExecStatus::ALL_GOOD;
-            }
-            case OpCodes::JUMP_IF_FALSE: {
-                auto addrs = eval_operand_addrs(2, modes, pc + 1);
-                pc = tape[addrs[0]] == 0 ? tape[addrs[1]] : pc + 3;
+            case OpCodes::JUMP_IF_FALSE:
+                cpu.pc = tape[cpu.template addr<M1>(pc + 1)] == 0 ? tape[cpu.template addr<M2>(pc + 2)] : pc + 3;
                 return InstrExecStatus::ALL_GOOD;
-            }
-            case OpCodes::LESS_THAN: {
-                auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] < tape[addrs[1]] ? 1 : 0;
-                pc += 4;
+            case OpCodes::LESS_THAN:
+                tape[cpu.template addr<M3>(pc + 3)] = tape[cpu.template addr<M1>(pc + 1)] < tape[cpu.template addr<M2>(pc + 2)] ? 1 : 0;
+                cpu.pc += 4;
                 return InstrExecStatus::ALL_GOOD;
-            }
-            case OpCodes::EQUALS: {
-                auto addrs = eval_operand_addrs(3, modes, pc + 1);
-                tape[addrs[2]] = tape[addrs[0]] == tape[addrs[1]] ? 1 : 0;
-                pc += 4;
+            case OpCodes::EQUALS:
+                tape[cpu.template addr<M3>(pc + 3)] = tape[cpu.template addr<M1>(pc + 1)] == tape[cpu.template addr<M2>(pc + 2)] ? 1 : 0;
+                cpu.pc += 4;
                 return InstrExecStatus::ALL_GOOD;
-            }
-            case OpCodes::SET_REL_OFFSET: {
-                auto addrs = eval_operand_addrs(1, modes, pc + 1);
-                relative_addr_base += tape[addrs[0]];
-                pc += 2;
+            case OpCodes::SET_REL_OFFSET:
+                cpu.relative_addr_base += tape[cpu.template addr<M1>(pc + 1)];
+                cpu.pc += 2;
                 return InstrExecStatus::ALL_GOOD;
-            }
             case OpCodes::HALT: return InstrExecStatus::HALT;
             default: return InstrExecStatus::UNKOWN_OPCODE;
         }
     }
 
-    void mem_dump(size_t start, size_t end) {
-        for (int i = start; i < end; i++) {
-            std::cout << i << ": " << tape[i] << std::endl;
-        }
+    static InstrExecStatus unknown_opcode(BasicCPU&) {
+        return InstrExecStatus::UNKOWN_OPCODE;
     }
-private:
-    Tape tape;
-
-    // Program counter
-    size_t pc;
 
-    // Base pointer for relative addressing
-    size_t relative_addr_base;
+    // Instantiates `execute` for handler number `I`, then for the ones below it. The 270
+    // handlers are the 27 mode triples of each of the ten opcodes, HALT being the last
+    template <int I>
+    static void fill_handlers(std::vector<handler_t>& table, std::integral_constant<int, I>) {
+        const int op = I / 27 < 9 ? I / 27 + 1 : 99;
+        const int m1 = I % 3, m2 = I / 3 % 3, m3 = I / 9 % 3;
+        table[op + 100 * m1 + 1000 * m2 + 10000 * m3] = &execute<op, m1, m2, m3>;
+        fill_handlers(table, std::integral_constant<int, I - 1>());
+    }
 
-    std::istream &in;
-    std::ostream &out;
+    static void fill_handlers(std::vector<handler_t>&, std::integral_constant<int, -1>) {}
 
-    int eval_operand_addr(int mode, size_t position) {
-        switch (static_cast<AddressingModes>(mode)) {
-            case AddressingModes::POSITION:  return tape[position];
-            case AddressingModes::IMMEDIATE: return position;
-            case AddressingModes::RELATIVE:  return relative_addr_base + tape[position];
-        }
-    }
+    static const handler_t* handler_table() {
+        static const std::vector<handler_t> table = [] {
+            std::vector<handler_t> table(n_handlers, &unknown_opcode);
+            fill_handlers(table, std::integral_constant<int, 10 * 27 - 1>());
 
-    std::vector<int> eval_operand_addrs(int how_many, int modes, size_t position) {
-        std::vector<int> ret;
-        for(; how_many > 0; how_many--, modes /= 10, position++) {
-            ret.push_back(eval_operand_addr(modes % 10, position));
-        }
-        return ret;
+            // Words with mode digits the opcode doesn't use run like the word without them,
+            // e.g. 399 halts. A mode digit above 2 on a parameter the opcode has is unknown
+            for (size_t word = 0; word < n_handlers; word++) table[word] = table[drop_unused_modes(word)];
+            return table;
+        }();
+        return table.data();
     }
 };
 
+using CPU = BasicCPU<>;
+
 Tape read_tape_from_disk(std::string filename) {
     Tape tape;
-    std::ifstream file(filename, 0);
+    std::ifstream file(filename);
 
     size_t head_pos = 0;
     std::string val;
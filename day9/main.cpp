@@ -1,12 +1,76 @@
 #include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 
 #include "cpu.hpp"
+#include "perf.hpp"
+#include "stream.hpp"
 
+// Runs the program twice on the same input: once with the counters around the whole run,
+// and once with the counters read around every instruction. The report goes to stderr
+void run_with_perf_counters(const Tape& tape) {
+    std::string input((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
 
-int main() {
+    PerfCounters counters;
+
+    {
+        std::istringstream in(input);
+        CPU cpu = CPU(tape, in, std::cout);
+        CountingProbe probe;
+        auto start = counters.read();
+        cpu.run_program(probe);
+        auto end = counters.read();
+        report_run(std::cerr, counters, start, end, probe.total());
+    }
+
+    {
+        std::istringstream in(input);
+        std::ostringstream out;
+        CPU cpu = CPU(tape, in, out);
+        PerfProbe probe(counters);
+        cpu.run_program(probe);
+        probe.report(std::cerr);
+    }
+}
+
+// Runs the program as a filter over a stream of integers, from stdin or from a mapped file,
+// with buffered reads and writes straight on the file descriptors
+void run_streaming(const Tape& tape, const std::string& input_file) {
+    FastWriter out(STDOUT_FILENO);
+
+    if (input_file.empty()) {
+        FastReader in(STDIN_FILENO);
+        in.tie(&out);
+        BasicCPU<FastReader, FastWriter>(tape, in, out).run_program();
+    } else {
+        FastReader in(input_file);
+        BasicCPU<FastReader, FastWriter>(tape, in, out).run_program();
+    }
+}
+
+int main(int argc, char** argv) {
     Tape tape = read_tape_from_disk("input.txt");
+
+    if (argc > 1 && std::string(argv[1]) == "--perf") {
+        run_with_perf_counters(tape);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--stream") {
+        try {
+            run_streaming(tape, argc > 2 ? argv[2] : "");
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl
+                      << "usage: " << argv[0] << " --stream [file of integers]" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     CPU cpu = CPU(tape, std::cin, std::cout);
     cpu.run_program();
-}
\ No newline at end of file
+}
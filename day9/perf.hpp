@@ -0,0 +1,232 @@
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware performance counters (Linux only) and probes for instrumenting a CPU run.
+// A probe is anything with `before(opcode)` and `after(opcode)` member functions;
+// see `CPU::run_program(Probe&)`.
+
+enum Counter {
+    CYCLES, INSTRUCTIONS, BRANCH_MISSES, L1D_MISSES, N_COUNTERS
+};
+
+using counts_t = std::array<uint64_t, N_COUNTERS>;
+
+const std::array<std::string, N_COUNTERS> counter_labels{
+    "cycles", "instructions", "branch-misses", "L1D-misses"
+};
+
+// A group of user-space-only counters that are read together with a single syscall
+class PerfCounters {
+public:
+    PerfCounters() {
+        fds.fill(-1);
+#ifdef __linux__
+        const std::array<std::pair<uint32_t, uint64_t>, N_COUNTERS> events{{
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                 (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        }};
+
+        for (int i = 0; i < N_COUNTERS; i++) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.disabled = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+
+            fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+            if (fds[i] < 0) {
+                close_all();
+                return;
+            }
+        }
+
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    ~PerfCounters() { close_all(); }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const { return fds[0] >= 0; }
+
+    // Current (monotonically increasing) value of every counter. All zeros if unavailable
+    counts_t read() const {
+        counts_t counts{};
+#ifdef __linux__
+        if (!available()) return counts;
+
+        // Layout for PERF_FORMAT_GROUP: number of counters, followed by each value
+        std::array<uint64_t, N_COUNTERS + 1> buf{};
+        if (::read(fds[0], buf.data(), sizeof(buf)) == sizeof(buf)) {
+            for (int i = 0; i < N_COUNTERS; i++) counts[i] = buf[i + 1];
+        }
+#endif
+        return counts;
+    }
+
+private:
+    std::array<int, N_COUNTERS> fds;
+
+    void close_all() {
+#ifdef __linux__
+        for (auto& fd : fds) {
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+#endif
+    }
+};
+
+struct OpcodeProfile {
+    uint64_t executed = 0;
+    counts_t counts{};
+};
+
+std::string opcode_label(int opcode) {
+    switch (opcode) {
+        case 1:  return "ADD";
+        case 2:  return "MULT";
+        case 3:  return "INPUT";
+        case 4:  return "OUTPUT";
+        case 5:  return "JUMP_IF_TRUE";
+        case 6:  return "JUMP_IF_FALSE";
+        case 7:  return "LESS_THAN";
+        case 8:  return "EQUALS";
+        case 9:  return "SET_REL_OFFSET";
+        case 99: return "HALT";
+        default: return "UNKNOWN(" + std::to_string(opcode) + ")";
+    }
+}
+
+// Only counts executed instructions per opcode. Cheap enough to wrap a whole run that is
+// itself measured by a `PerfCounters` group
+class CountingProbe {
+public:
+    // Negative words have no opcode, they are counted apart
+    void before(int opcode) {
+        if (opcode < 0) {
+            invalid++;
+            return;
+        }
+        auto index = static_cast<size_t>(opcode % 100);
+        if (index < executed.size()) executed[index]++;
+        else invalid++;
+    }
+    void after(int) {}
+
+    uint64_t total() const {
+        uint64_t n = invalid;
+        for (auto count : executed) n += count;
+        return n;
+    }
+
+    std::array<uint64_t, 100> executed{};
+    uint64_t invalid = 0;
+};
+
+// Reads the counters around every single Intcode instruction and attributes the deltas to
+// its opcode. The cost of the reads themselves is measured up front and subtracted
+class PerfProbe {
+public:
+    explicit PerfProbe(const PerfCounters& counters): counters(counters) {
+        calibrate();
+    }
+
+    void before(int) {
+        start = counters.read();
+    }
+
+    void after(int opcode) {
+        auto end = counters.read();
+        auto& profile = profiles[opcode % 100];
+        profile.executed++;
+        for (int i = 0; i < N_COUNTERS; i++) {
+            auto delta = end[i] - start[i];
+            profile.counts[i] += delta > overhead[i] ? delta - overhead[i] : 0;
+        }
+    }
+
+    void report(std::ostream& out) const {
+        if (!counters.available()) {
+            out << "perf_event_open unavailable, reporting instruction counts only" << std::endl;
+        }
+
+        OpcodeProfile total;
+        for (const auto& kv : profiles) {
+            total.executed += kv.second.executed;
+            for (int i = 0; i < N_COUNTERS; i++) total.counts[i] += kv.second.counts[i];
+        }
+
+        out << std::setw(16) << "opcode" << std::setw(12) << "executed";
+        for (const auto& label : counter_labels) out << std::setw(18) << label + "/op";
+        out << std::endl;
+
+        for (const auto& kv : profiles) print_row(out, opcode_label(kv.first), kv.second);
+        print_row(out, "all", total);
+    }
+
+private:
+    const PerfCounters& counters;
+    counts_t start{};
+    counts_t overhead{};
+    std::map<int, OpcodeProfile> profiles;
+
+    void calibrate() {
+        const int rounds = 10000;
+        counts_t sum{};
+        for (int r = 0; r < rounds; r++) {
+            auto a = counters.read();
+            auto b = counters.read();
+            for (int i = 0; i < N_COUNTERS; i++) sum[i] += b[i] - a[i];
+        }
+        for (int i = 0; i < N_COUNTERS; i++) overhead[i] = sum[i] / rounds;
+    }
+
+    static void print_row(std::ostream& out, const std::string& label, const OpcodeProfile& profile) {
+        out << std::setw(16) << label << std::setw(12) << profile.executed;
+        for (int i = 0; i < N_COUNTERS; i++) {
+            out << std::setw(18) << std::fixed << std::setprecision(2)
+                << (profile.executed > 0 ? static_cast<double>(profile.counts[i]) / profile.executed : 0);
+        }
+        out << std::endl;
+    }
+};
+
+// Counters around a whole run, normalized by the number of Intcode instructions executed
+void report_run(std::ostream& out, const PerfCounters& counters,
+                const counts_t& start, const counts_t& end, uint64_t executed) {
+    out << "Whole run: " << executed << " Intcode instructions";
+    if (!counters.available()) {
+        out << std::endl;
+        return;
+    }
+    for (int i = 0; i < N_COUNTERS; i++) {
+        out << ", " << std::fixed << std::setprecision(2)
+            << (executed > 0 ? static_cast<double>(end[i] - start[i]) / executed : 0)
+            << " " << counter_labels[i] << "/op";
+    }
+    out << std::endl;
+}
@@ -0,0 +1,170 @@
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Buffered integer I/O straight on file descriptors, for running a CPU as a Unix filter
+// (see `BasicCPU`). Numbers are parsed and formatted by hand, without locales or stdio.
+
+class FastWriter {
+public:
+    explicit FastWriter(int fd, size_t buffer_size = 1 << 16): fd(fd), buf(buffer_size), pos(0) {}
+    ~FastWriter() { flush(); }
+
+    FastWriter(const FastWriter&) = delete;
+    FastWriter& operator=(const FastWriter&) = delete;
+
+    FastWriter& operator<<(long long int n) {
+        if (buf.size() - pos < 24) flush();
+
+        // Digits are produced backwards, the unsigned negation also covers the smallest value
+        char digits[20];
+        int len = 0;
+        unsigned long long v = n < 0 ? -static_cast<unsigned long long>(n) : n;
+        do {
+            digits[len++] = '0' + v % 10;
+            v /= 10;
+        } while (v > 0);
+
+        if (n < 0) buf[pos++] = '-';
+        while (len > 0) buf[pos++] = digits[--len];
+        return *this;
+    }
+
+    FastWriter& operator<<(long int n) { return *this << static_cast<long long int>(n); }
+
+    FastWriter& operator<<(char c) {
+        if (pos == buf.size()) flush();
+        buf[pos++] = c;
+        return *this;
+    }
+
+    void flush() {
+        size_t written = 0;
+        while (written < pos) {
+            auto n = ::write(fd, buf.data() + written, pos - written);
+            if (n < 0) throw std::runtime_error("write failed: " + std::string(std::strerror(errno)));
+            written += n;
+        }
+        pos = 0;
+    }
+
+private:
+    const int fd;
+    std::vector<char> buf;
+    size_t pos;
+};
+
+// Reads whitespace (or comma) separated integers, either from a file descriptor through a
+// buffer, or from a whole file mapped in memory. Like an `std::istream`, it converts to false
+// once it reached the end of the input. Anything else than an integer, or one that doesn't
+// fit in 64 bits, throws
+class FastReader {
+public:
+    explicit FastReader(int fd, size_t buffer_size = 1 << 16):
+        fd(fd), buf(buffer_size), begin(nullptr), end(nullptr), mapped(nullptr), mapped_size(0), tied(nullptr), good(true) {}
+
+    // Maps the whole of `filename`, so reading never makes a syscall
+    explicit FastReader(const std::string& filename):
+        fd(-1), begin(nullptr), end(nullptr), mapped(nullptr), mapped_size(0), tied(nullptr), good(true) {
+        int file = ::open(filename.c_str(), O_RDONLY);
+        if (file < 0) throw std::runtime_error("Could not open " + filename);
+
+        struct stat st;
+        if (fstat(file, &st) == 0 && st.st_size > 0) {
+            mapped_size = st.st_size;
+            void* p = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (p == MAP_FAILED) {
+                ::close(file);
+                throw std::runtime_error("Could not map " + filename);
+            }
+            madvise(p, mapped_size, MADV_SEQUENTIAL);
+            mapped = static_cast<char*>(p);
+            begin = mapped;
+            end = mapped + mapped_size;
+        }
+        ::close(file);
+    }
+
+    ~FastReader() {
+        if (mapped != nullptr) munmap(mapped, mapped_size);
+    }
+
+    FastReader(const FastReader&) = delete;
+    FastReader& operator=(const FastReader&) = delete;
+
+    // `writer` gets flushed before blocking for more input, so the program's answers reach
+    // whoever is on the other end of an interactive pipe before it waits for them
+    void tie(FastWriter* writer) { tied = writer; }
+
+    FastReader& operator>>(long long int& n) {
+        int c;
+        while ((c = peek()) >= 0 && (c == ',' || std::isspace(c))) begin++;
+        if (c < 0) {
+            good = false;
+            return *this;
+        }
+
+        bool negative = c == '-';
+        if (negative) begin++;
+
+        // The magnitude of the smallest value is one more than the largest one's
+        const unsigned long long limit = static_cast<unsigned long long>(std::numeric_limits<long long int>::max()) + negative;
+        unsigned long long v = 0;
+        bool any = false;
+        while ((c = peek()) >= '0' && c <= '9') {
+            if (v > (limit - (c - '0')) / 10) throw std::runtime_error("Integer out of range in the input");
+            v = v * 10 + (c - '0');
+            begin++;
+            any = true;
+        }
+
+        if (c >= 0 && c != ',' && !std::isspace(c)) {
+            throw std::runtime_error("Unexpected character '" + std::string(1, c) + "' in the input");
+        }
+        if (!any) throw std::runtime_error("Expected digits after '-' in the input");
+        n = static_cast<long long int>(negative ? 0 - v : v);
+        return *this;
+    }
+
+    explicit operator bool() const { return good; }
+
+private:
+    const int fd;
+    std::vector<char> buf;
+    char* begin;
+    char* end;
+
+    char* mapped;
+    size_t mapped_size;
+
+    FastWriter* tied;
+    bool good;
+
+    // Next character without consuming it, -1 at the end of the input
+    int peek() {
+        if (begin == end && !refill()) return -1;
+        return static_cast<unsigned char>(*begin);
+    }
+
+    bool refill() {
+        if (fd < 0) return false;
+        if (tied != nullptr) tied->flush();
+
+        ssize_t n;
+        while ((n = ::read(fd, buf.data(), buf.size())) < 0 && errno == EINTR);
+        if (n <= 0) return false;
+        begin = buf.data();
+        end = begin + n;
+        return true;
+    }
+};
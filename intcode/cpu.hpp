@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The Intcode VM shared by the tools (optimizer, partial, jobserver). Memory is one flat
+// vector that grows when the program writes past its end, and running an instruction
+// allocates nothing. The days keep their own CPUs, and bench/cpu.hpp keeps the original one
+// as the baseline to measure against.
+
+using Tape = std::unordered_map<size_t,long long int>;
+
+// A program as flat memory: cell i at index i
+using Image = std::vector<long long int>;
+
+enum class InstrExecStatus {
+    IDLE, ALL_GOOD, HALT, UNKOWN_OPCODE, NO_INPUT, OUTPUT, OUT_OF_BUDGET, BAD_ADDRESS,
+};
+
+// Events `CPU::run_until` stops on, besides the program halting. Combine them with |
+enum StopMask : unsigned {
+    // Before an INPUT instruction, if there is no input to read. The input queue can't be
+    // waited on, so an INPUT with nothing to read stops the run whether this is set or not
+    STOP_ON_INPUT  = 1 << 0,
+
+    // After the nth OUTPUT instruction
+    STOP_ON_OUTPUT = 1 << 1,
+};
+
+enum class OpCodes {
+    ADD            = 1,
+    MULT           = 2,
+    INPUT          = 3,
+    OUTPUT         = 4,
+    JUMP_IF_TRUE   = 5,
+    JUMP_IF_FALSE  = 6,
+    LESS_THAN      = 7,
+    EQUALS         = 8,
+    SET_REL_OFFSET = 9,
+    HALT           = 99,
+};
+
+enum class AddressingModes {
+    POSITION  = 0,
+    IMMEDIATE = 1,
+    RELATIVE  = 2,
+};
+
+Image to_image(const Tape& tape) {
+    size_t size = 0;
+    for (const auto& cell : tape) size = std::max(size, cell.first + 1);
+
+    Image image(size, 0);
+    for (const auto& cell : tape) image[cell.first] = cell.second;
+    return image;
+}
+
+class CPU {
+public:
+    // Far more memory than any of the puzzles use. A program addressing memory past it, or
+    // below 0, stops with BAD_ADDRESS instead of taking all of the machine's memory
+    static const long long int max_cells = 1ll << 24;
+
+    explicit CPU(const Tape& tape): CPU(to_image(tape)) {}
+
+    // Also resumes a machine saved with `get_memory`, `get_pc` and `get_relative_addr_base`
+    explicit CPU(Image memory, size_t pc = 0, size_t relative_addr_base = 0):
+        memory(std::move(memory)),
+        pc(pc),
+        relative_addr_base(relative_addr_base),
+        instructions_executed(0) {}
+
+    InstrExecStatus run_program() {
+        return run_until(0);
+    }
+
+    InstrExecStatus run_until_more_input_is_required() {
+        return run_until(STOP_ON_INPUT);
+    }
+
+    // Runs until the program halts, stops on one of the `stop` events, or `budget`
+    // instructions ran. Each instruction word is fetched once, and events are only checked
+    // for the INPUT and OUTPUT instructions
+    InstrExecStatus run_until(unsigned stop, uint64_t n = 1,
+                              uint64_t budget = std::numeric_limits<uint64_t>::max()) {
+        uint64_t outputs = 0;
+        for (; budget > 0; budget--) {
+            auto instr = load(pc);
+            auto opcode = static_cast<OpCodes>(instr % 100);
+            if (opcode == OpCodes::INPUT && in.empty()) return InstrExecStatus::NO_INPUT;
+
+            instructions_executed++;
+            auto status = execute(opcode, instr / 100);
+            if (status != InstrExecStatus::ALL_GOOD) return status;
+            if (opcode == OpCodes::OUTPUT && (stop & STOP_ON_OUTPUT) && ++outputs == n) {
+                return InstrExecStatus::OUTPUT;
+            }
+        }
+        return InstrExecStatus::OUT_OF_BUDGET;
+    }
+
+    std::queue<long long int>& get_in() { return in; }
+    std::queue<long long int>& get_out() { return out; }
+
+    // Number of instructions executed so far, including the one that stopped the program
+    uint64_t get_instructions_executed() const { return instructions_executed; }
+
+    // Memory up to the highest cell written so far, at least the whole program
+    const Image& get_memory() const { return memory; }
+    size_t get_pc() const { return pc; }
+    size_t get_relative_addr_base() const { return relative_addr_base; }
+
+private:
+    Image memory;
+
+    // Program counter
+    long long int pc;
+
+    // Base pointer for relative addressing
+    long long int relative_addr_base;
+
+    uint64_t instructions_executed;
+
+    std::queue<long long int> in;
+    std::queue<long long int> out;
+
+    // Cells past the end of memory hold zero
+    long long int load(long long int addr) const {
+        return static_cast<unsigned long long>(addr) < memory.size() ? memory[addr] : 0;
+    }
+
+    // `addr` must have come from `param_addrs`
+    void store(long long int addr, long long int value) {
+        if (static_cast<size_t>(addr) >= memory.size()) {
+            memory.resize(std::min<size_t>(static_cast<size_t>(max_cells), std::max<size_t>(addr + 1, 2 * memory.size())), 0);
+        }
+        memory[addr] = value;
+    }
+
+    // Addresses of the first `count` parameters of the instruction at pc. False if one of
+    // them is outside of memory or has an unknown mode
+    bool param_addrs(long long int modes, int count, long long int* addrs) const {
+        for (int i = 0; i < count; i++, modes /= 10) {
+            auto position = pc + 1 + i;
+            long long int addr;
+            switch (static_cast<AddressingModes>(modes % 10)) {
+                case AddressingModes::POSITION:  addr = load(position); break;
+                case AddressingModes::IMMEDIATE: addr = position; break;
+                case AddressingModes::RELATIVE:  addr = relative_addr_base + load(position); break;
+                default: return false;
+            }
+            if (addr < 0 || addr >= max_cells) return false;
+            addrs[i] = addr;
+        }
+        return true;
+    }
+
+    InstrExecStatus execute(OpCodes opcode, long long int modes) {
+        long long int addrs[3];
+        switch (opcode) {
+            case OpCodes::ADD:
+            case OpCodes::MULT:
+            case OpCodes::LESS_THAN:
+            case OpCodes::EQUALS: {
+                if (!param_addrs(modes, 3, addrs)) return InstrExecStatus::BAD_ADDRESS;
+                auto a = load(addrs[0]), b = load(addrs[1]);
+                long long int value;
+                switch (opcode) {
+                    case OpCodes::ADD:       value = a + b; break;
+                    case OpCodes::MULT:      value = a * b; break;
+                    case OpCodes::LESS_THAN: value = a < b ? 1 : 0; break;
+                    default:                 value = a == b ? 1 : 0; break;
+                }
+                store(addrs[2], value);
+                pc += 4;
+                return InstrExecStatus::ALL_GOOD;
+            }
+            case OpCodes::INPUT: {
+                if (!param_addrs(modes, 1, addrs)) return InstrExecStatus::BAD_ADDRESS;
+                store(addrs[0], in.front());
+                in.pop();
+                pc += 2;
+                return InstrExecStatus::ALL_GOOD;
+            }
+            case OpCodes::OUTPUT: {
+                if (!param_addrs(modes, 1, addrs)) return InstrExecStatus::BAD_ADDRESS;
+                out.push(load(addrs[0]));
+                pc += 2;
+                return InstrExecStatus::ALL_GOOD;
+            }
+            case OpCodes::JUMP_IF_TRUE:
+            case OpCodes::JUMP_IF_FALSE: {
+                if (!param_addrs(modes, 2, addrs)) return InstrExecStatus::BAD_ADDRESS;
+                bool jump = (load(addrs[0]) != 0) == (opcode == OpCodes::JUMP_IF_TRUE);
+                pc = jump ? load(addrs[1]) : pc + 3;
+                return InstrExecStatus::ALL_GOOD;
+            }
+            case OpCodes::SET_REL_OFFSET: {
+                if (!param_addrs(modes, 1, addrs)) return InstrExecStatus::BAD_ADDRESS;
+                relative_addr_base += load(addrs[0]);
+                pc += 2;
+                return InstrExecStatus::ALL_GOOD;
+            }
+            case OpCodes::HALT: return InstrExecStatus::HALT;
+            default: return InstrExecStatus::UNKOWN_OPCODE;
+        }
+    }
+};
+
+// Reads a comma separated program. Throws if a value isn't a number
+Image read_image(std::istream& in) {
+    Image image;
+    std::string val;
+    while (std::getline(in, val, ',')) image.push_back(std::stoll(val));
+    return image;
+}
+
+Tape read_tape(std::istream& in) {
+    auto image = read_image(in);
+    Tape tape;
+    for (size_t addr = 0; addr < image.size(); addr++) tape[addr] = image[addr];
+    return tape;
+}
+
+Tape read_tape_from_disk(std::string filename) {
+    std::ifstream file(filename);
+    return read_tape(file);
+}
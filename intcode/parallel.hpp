@@ -0,0 +1,20 @@
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Runs `f(0)` ... `f(n - 1)` on all cores. Indices are handed out one at a time, so uneven
+// work balances itself
+void parallel_for(size_t n, const std::function<void(size_t)>& f) {
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i; (i = next++) < n; ) f(i);
+    };
+
+    std::vector<std::thread> threads;
+    auto n_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned t = 1; t < n_threads && t < n; t++) threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads) thread.join();
+}
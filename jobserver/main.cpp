@@ -0,0 +1,495 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "../intcode/cpu.hpp"
+#include "socket.hpp"
+
+// A long-lived Intcode server. Clients send one request per line over a Unix domain socket:
+//
+//   LOAD <program>                  -> OK <id>
+//   RUN <id> <budget> [inputs...]   -> OUT <value>, ..., DONE <status> <instructions>
+//
+// A program id is the hash of its text, so loading the same program twice is free and its
+// id is known without asking. Programs that haven't been used for a while can be evicted,
+// and then have to be loaded again. A budget of 0 means no limit on the number of instructions.
+// Jobs stop on HALT, when they need more input than they were given (NEED_INPUT), when the
+// budget runs out (BUDGET), on an unknown opcode (UNKNOWN_OPCODE) or on an address outside
+// of memory (BAD_ADDRESS). Outputs are sent back while the job runs. Errors are answered
+// with ERR <message>
+
+// 64-bit FNV-1a of the program text, whitespace left out
+uint64_t program_id(const std::string& code) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : code) {
+        if (std::isspace(c)) continue;
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string to_hex(uint64_t id) {
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << id;
+    return out.str();
+}
+
+// Parsed program images, shared read-only by all the jobs running them. An image is flat
+// memory, so starting a job costs a single copy. Past `capacity`
+// programs, loading one evicts the least recently used. Jobs running it keep their image
+class ProgramCache {
+public:
+    explicit ProgramCache(size_t capacity): capacity(capacity) {}
+
+    uint64_t load(const std::string& code) {
+        auto id = program_id(code);
+        if (find(id)) return id;
+
+        // Parse without holding the lock, a racing load of the same program is harmless
+        std::istringstream in(code);
+        auto image = std::make_shared<const Image>(read_image(in));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (programs.count(id) > 0) return id;
+        recent.push_front(id);
+        programs.emplace(id, Entry{image, recent.begin()});
+        if (programs.size() > capacity) {
+            programs.erase(recent.back());
+            recent.pop_back();
+        }
+        return id;
+    }
+
+    std::shared_ptr<const Image> find(uint64_t id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = programs.find(id);
+        if (it == programs.end()) return nullptr;
+
+        recent.splice(recent.begin(), recent, it->second.recent);
+        return it->second.image;
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<const Image> image;
+        std::list<uint64_t>::iterator recent;
+    };
+
+    const size_t capacity;
+    std::mutex mutex;
+    std::unordered_map<uint64_t, Entry> programs;
+
+    // Program ids, most recently used first
+    std::list<uint64_t> recent;
+};
+
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned n_threads): stopping(false) {
+        for (unsigned i = 0; i < n_threads; i++) threads.emplace_back([this] { work(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto& thread : threads) thread.join();
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push(std::move(task));
+        }
+        ready.notify_one();
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool stopping;
+
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+};
+
+// Outputs are sent in chunks of about this many bytes while a job runs
+const size_t stream_chunk = 4096;
+
+// Runs one job on a fresh copy of `image`, writing its outputs to `out` as they come
+void run_job(const Image& image, const std::vector<long long int>& inputs, uint64_t budget, LineWriter& out) {
+    CPU cpu(image);
+    for (auto v : inputs) cpu.get_in().push(v);
+
+    InstrExecStatus result;
+    while (true) {
+        auto left = budget > 0 ? budget - cpu.get_instructions_executed() : std::numeric_limits<uint64_t>::max();
+        result = cpu.run_until(STOP_ON_OUTPUT, 1, left);
+        for (auto& q = cpu.get_out(); !q.empty(); q.pop()) out << "OUT " << q.front() << '\n';
+        if (result != InstrExecStatus::OUTPUT) break;
+        if (out.pending() >= stream_chunk && !out.flush()) return;
+    }
+
+    std::string status;
+    switch (result) {
+        case InstrExecStatus::HALT:          status = "HALT"; break;
+        case InstrExecStatus::NO_INPUT:      status = "NEED_INPUT"; break;
+        case InstrExecStatus::OUT_OF_BUDGET: status = "BUDGET"; break;
+        case InstrExecStatus::BAD_ADDRESS:   status = "BAD_ADDRESS"; break;
+        default:                             status = "UNKNOWN_OPCODE"; break;
+    }
+    out << "DONE " << status << ' ' << static_cast<long long int>(cpu.get_instructions_executed()) << '\n';
+}
+
+// Answers one request
+void handle_request(const std::string& line, ProgramCache& cache, LineWriter& out) {
+    std::istringstream words(line);
+    std::string command;
+    words >> command;
+
+    if (command == "LOAD") {
+        std::string code;
+        std::getline(words >> std::ws, code);
+        uint64_t id;
+        try {
+            id = cache.load(code);
+        } catch (const std::exception&) {
+            out << "ERR could not parse program\n";
+            return;
+        }
+        out << "OK " << to_hex(id) << '\n';
+    } else if (command == "RUN") {
+        uint64_t id, budget;
+        std::vector<long long int> inputs;
+        if (!(words >> std::hex >> id >> std::dec >> budget)) {
+            out << "ERR usage: RUN <id> <budget> [inputs...]\n";
+        } else if (auto image = cache.find(id)) {
+            for (long long int v; words >> v; ) inputs.push_back(v);
+            if (!words.eof()) {
+                out << "ERR inputs must be integers\n";
+                return;
+            }
+            run_job(*image, inputs, budget, out);
+        } else {
+            out << "ERR unknown program " << to_hex(id) << '\n';
+        }
+    } else {
+        out << "ERR unknown command " << command << '\n';
+    }
+}
+
+// A client connection. Only a connection with a request to answer takes a thread of the
+// pool, so idle clients don't keep others from being served
+struct Connection {
+    explicit Connection(int fd): fd(fd), in(fd), out(fd), open(true) {}
+
+    const int fd;
+    LineReader in;
+    LineWriter out;
+    bool open;
+};
+
+// Reads what the client sent and answers every whole request in it, in order. Only called
+// once poll found the connection readable, so the read doesn't block
+void serve_ready(Connection& conn, ProgramCache& cache) {
+    if (!conn.in.fill()) {
+        conn.open = false;
+        return;
+    }
+
+    std::string line;
+    while (conn.out && conn.in.buffered_line(line)) {
+        handle_request(line, cache, conn.out);
+        conn.out.flush();
+    }
+    conn.open = static_cast<bool>(conn.out);
+}
+
+// Waits for requests on every idle connection, and hands each connection that has some to
+// the pool. The pool hands it back through `wake` once it's done, so a connection never has
+// two batches of requests answered at once and its replies stay in order
+void serve_on(int listener, unsigned n_threads, size_t max_programs) {
+    ProgramCache cache(max_programs);
+    ThreadPool pool(n_threads);
+
+    int wake[2];
+    if (pipe(wake) < 0) throw std::runtime_error("pipe failed: " + std::string(std::strerror(errno)));
+
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    std::unordered_set<int> idle;
+
+    std::mutex mutex;
+    std::vector<int> handed_back;
+
+    std::vector<pollfd> fds;
+    while (true) {
+        fds.assign({{listener, POLLIN, 0}, {wake[0], POLLIN, 0}});
+        for (auto fd : idle) fds.push_back({fd, POLLIN, 0});
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("poll failed: " + std::string(std::strerror(errno)));
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd >= 0) {
+                connections[fd].reset(new Connection(fd));
+                idle.insert(fd);
+            } else if (errno != EINTR && errno != ECONNABORTED) {
+                throw std::runtime_error("accept failed: " + std::string(std::strerror(errno)));
+            }
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(wake[0], drain, sizeof(drain)) < 0 && errno == EINTR);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto fd : handed_back) {
+                if (connections[fd]->open) {
+                    idle.insert(fd);
+                } else {
+                    close(fd);
+                    connections.erase(fd);
+                }
+            }
+            handed_back.clear();
+        }
+
+        for (size_t i = 2; i < fds.size(); i++) {
+            if (fds[i].revents == 0) continue;
+
+            auto fd = fds[i].fd;
+            idle.erase(fd);
+            auto conn = connections[fd].get();
+            pool.submit([conn, &cache, &mutex, &handed_back, &wake] {
+                serve_ready(*conn, cache);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    handed_back.push_back(conn->fd);
+                }
+                char c = 0;
+                while (write(wake[1], &c, 1) < 0 && errno == EINTR);
+            });
+        }
+    }
+}
+
+void serve(const std::string& path, unsigned n_threads, size_t max_programs) {
+    int listener = listen_on(path);
+    std::cerr << "Listening on " << path << " with " << n_threads << " threads, keeping up to "
+              << max_programs << " programs" << std::endl;
+    serve_on(listener, n_threads, max_programs);
+}
+
+// Sends a whole program file, as one line
+std::string load(int fd, LineReader& in, const std::string& filename) {
+    std::ifstream file(filename);
+    std::string code((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    code.erase(std::remove(code.begin(), code.end(), '\n'), code.end());
+
+    LineWriter out(fd);
+    out << "LOAD " << code << '\n';
+    out.flush();
+
+    std::string reply;
+    if (!in.getline(reply) || reply.compare(0, 3, "OK ") != 0) throw std::runtime_error("LOAD failed: " + reply);
+    return reply.substr(3);
+}
+
+// Sends a job and calls `on_line` with every line of the reply, up to and including DONE
+void run(int fd, LineReader& in, const std::string& id, const std::string& budget,
+         const std::vector<std::string>& inputs, const std::function<void(const std::string&)>& on_line) {
+    LineWriter out(fd);
+    out << "RUN " << id << ' ' << budget;
+    for (const auto& v : inputs) out << ' ' << v;
+    out << '\n';
+    out.flush();
+
+    std::string reply;
+    while (in.getline(reply)) {
+        on_line(reply);
+        if (reply.compare(0, 4, "DONE") == 0 || reply.compare(0, 3, "ERR") == 0) return;
+    }
+    throw std::runtime_error("Server hung up");
+}
+
+// Runs the same job `n_jobs` times over one connection, and compares with what a fresh
+// process has to do for each job before it runs anything: reading and parsing the program
+void bench(int fd, LineReader& in, const std::string& filename, int n_jobs, const std::vector<std::string>& inputs) {
+    auto id = load(fd, in, filename);
+
+    using clock = std::chrono::steady_clock;
+    auto to_us = [](clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); };
+
+    std::string done;
+    auto start = clock::now();
+    for (int i = 0; i < n_jobs; i++) {
+        run(fd, in, id, "0", inputs, [&done](const std::string& line) { done = line; });
+    }
+    auto per_job = to_us(clock::now() - start) / n_jobs;
+
+    start = clock::now();
+    for (int i = 0; i < n_jobs; i++) {
+        std::ifstream file(filename);
+        read_image(file);
+    }
+    auto per_parse = to_us(clock::now() - start) / n_jobs;
+
+    std::cout << "Program " << id << ", last job: " << done << std::endl;
+    std::cout << std::fixed << std::setprecision(1)
+              << "Per job, on the server:        " << per_job << "us" << std::endl
+              << "Reading and parsing, per job:  " << per_parse << "us" << std::endl;
+}
+
+// Starts a server with one thread and room for two programs in a child process, and checks
+// its answers to a few requests, including the ones that went wrong before
+bool selftest() {
+    const std::string path = "/tmp/jobserver-selftest-" + std::to_string(getpid()) + ".sock";
+    int listener = listen_on(path);
+
+    auto server = fork();
+    if (server < 0) throw std::runtime_error("fork failed: " + std::string(std::strerror(errno)));
+    if (server == 0) {
+        serve_on(listener, 1, 2);
+        _exit(0);
+    }
+    close(listener);
+
+    bool ok = true;
+    auto check = [&ok](const std::string& what, const std::string& got, const std::string& expected) {
+        bool passed = got == expected;
+        ok = ok && passed;
+        std::cout << (passed ? "ok      " : "FAILED  ") << what;
+        if (!passed) std::cout << ": got \"" << got << "\", expected \"" << expected << "\"";
+        std::cout << std::endl;
+    };
+
+    // Replies come within a second or the check fails, instead of waiting forever
+    auto open = [&path]() {
+        int fd = connect_to(path);
+        timeval timeout{1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        return fd;
+    };
+    // The lines of the reply, up to the last one, joined with "; "
+    auto request = [](int fd, LineReader& in, const std::string& line) {
+        LineWriter out(fd);
+        out << line << '\n';
+        out.flush();
+
+        std::string reply, lines;
+        while (in.getline(reply)) {
+            lines += (lines.empty() ? "" : "; ") + reply;
+            if (reply.compare(0, 4, "OUT ") != 0) return lines;
+        }
+        return lines + (lines.empty() ? "" : "; ") + "(no reply)";
+    };
+
+    // Keeps the only thread of the pool if connections hold one while they're open
+    int idle = open();
+
+    int fd = open();
+    LineReader in(fd);
+    const std::string outputs_42 = "104,42,99", outputs_7 = "104,7,99", outputs_1 = "104,1,99";
+    auto id_42 = to_hex(program_id(outputs_42));
+
+    check("malformed LOAD", request(fd, in, "LOAD 1,2,x"), "ERR could not parse program");
+    check("LOAD", request(fd, in, "LOAD " + outputs_42), "OK " + id_42);
+    check("RUN while another client is idle", request(fd, in, "RUN " + id_42 + " 0"), "OUT 42; DONE HALT 2");
+    check("RUN with an input that isn't a number", request(fd, in, "RUN " + id_42 + " 0 1 x 2"),
+          "ERR inputs must be integers");
+
+    request(fd, in, "LOAD " + outputs_7);
+    request(fd, in, "RUN " + id_42 + " 1");
+    request(fd, in, "LOAD " + outputs_1);
+    check("LOAD evicts the least recently used program", request(fd, in, "RUN " + to_hex(program_id(outputs_7)) + " 1"),
+          "ERR unknown program " + to_hex(program_id(outputs_7)));
+    check("recently used programs stay", request(fd, in, "RUN " + id_42 + " 1"), "OUT 42; DONE BUDGET 1");
+
+    close(fd);
+    close(idle);
+    kill(server, SIGTERM);
+    waitpid(server, nullptr, 0);
+    unlink(path.c_str());
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (args.size() == 1 && args[0] == "--selftest") return selftest() ? 0 : 1;
+
+    if (args.size() < 2) {
+        std::cerr << "usage: " << argv[0] << " --serve <socket> [threads] [programs]" << std::endl
+                  << "       " << argv[0] << " --load <socket> <program file>" << std::endl
+                  << "       " << argv[0] << " --run <socket> <id> <budget> [inputs...]" << std::endl
+                  << "       " << argv[0] << " --bench <socket> <program file> <jobs> [inputs...]" << std::endl
+                  << "       " << argv[0] << " --selftest" << std::endl;
+        return 1;
+    }
+
+    const auto& mode = args[0];
+    const auto& path = args[1];
+
+    if (mode == "--serve") {
+        unsigned n_threads = args.size() > 2 ? std::stoul(args[2]) : std::max(1u, std::thread::hardware_concurrency());
+        size_t max_programs = args.size() > 3 ? std::stoul(args[3]) : 256;
+        serve(path, n_threads, max_programs);
+        return 0;
+    }
+
+    int fd = connect_to(path);
+    LineReader in(fd);
+
+    if (mode == "--load" && args.size() > 2) {
+        std::cout << load(fd, in, args[2]) << std::endl;
+    } else if (mode == "--run" && args.size() > 3) {
+        std::vector<std::string> inputs(args.begin() + 4, args.end());
+        run(fd, in, args[2], args[3], inputs, [](const std::string& line) {
+            if (line.compare(0, 4, "OUT ") == 0) std::cout << line.substr(4) << std::endl;
+            else std::cerr << line << std::endl;
+        });
+    } else if (mode == "--bench" && args.size() > 3) {
+        std::vector<std::string> inputs(args.begin() + 4, args.end());
+        bench(fd, in, args[2], std::stoi(args[3]), inputs);
+    } else {
+        std::cerr << "Bad arguments for " << mode << std::endl;
+        return 1;
+    }
+    close(fd);
+}
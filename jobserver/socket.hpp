@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Unix domain sockets and line based I/O on them, for the job server and its clients
+
+sockaddr_un socket_address(const std::string& path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("Socket path too long: " + path);
+    std::strcpy(addr.sun_path, path.c_str());
+    return addr;
+}
+
+// Listens on `path`, replacing whatever socket was left there
+int listen_on(const std::string& path) {
+    auto addr = socket_address(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error("socket failed: " + std::string(std::strerror(errno)));
+
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+        close(fd);
+        throw std::runtime_error("Could not listen on " + path + ": " + std::strerror(errno));
+    }
+    return fd;
+}
+
+int connect_to(const std::string& path) {
+    auto addr = socket_address(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error("socket failed: " + std::string(std::strerror(errno)));
+
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        throw std::runtime_error("Could not connect to " + path + ": " + std::strerror(errno));
+    }
+    return fd;
+}
+
+class LineReader {
+public:
+    explicit LineReader(int fd): fd(fd), buf(1 << 16), begin(0), end(0) {}
+
+    // Next line without its '\n'. False at the end of the stream, or if it ends mid-line
+    bool getline(std::string& line) {
+        while (!buffered_line(line)) {
+            if (!fill()) return false;
+        }
+        return true;
+    }
+
+    // Next line if all of it was read already, without reading anything
+    bool buffered_line(std::string& line) {
+        auto newline = std::find(buf.begin() + begin, buf.begin() + end, '\n');
+        if (newline == buf.begin() + end) return false;
+
+        line.assign(buf.begin() + begin, newline);
+        begin = newline - buf.begin() + 1;
+        return true;
+    }
+
+    // Reads once from the socket, which blocks unless something arrived already. The buffer
+    // grows as long as a line doesn't fit in it. False at the end of the stream
+    bool fill() {
+        std::copy(buf.begin() + begin, buf.begin() + end, buf.begin());
+        end -= begin;
+        begin = 0;
+        if (end == buf.size()) buf.resize(2 * buf.size());
+
+        ssize_t n;
+        while ((n = read(fd, buf.data() + end, buf.size() - end)) < 0 && errno == EINTR);
+        if (n <= 0) return false;
+        end += n;
+        return true;
+    }
+
+private:
+    const int fd;
+    std::vector<char> buf;
+    size_t begin, end;
+};
+
+// Buffers writes to a socket. Once a write failed, because the other end went away, the
+// writer stays failed and drops everything
+class LineWriter {
+public:
+    explicit LineWriter(int fd): fd(fd), good(true) {}
+
+    LineWriter& operator<<(const std::string& s) {
+        buf += s;
+        return *this;
+    }
+
+    LineWriter& operator<<(long long int n) { return *this << std::to_string(n); }
+
+    LineWriter& operator<<(char c) {
+        buf += c;
+        return *this;
+    }
+
+    size_t pending() const { return buf.size(); }
+
+    bool flush() {
+        size_t written = 0;
+        while (good && written < buf.size()) {
+            auto n = send(fd, buf.data() + written, buf.size() - written, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) good = false;
+            else written += n;
+        }
+        buf.clear();
+        return good;
+    }
+
+    explicit operator bool() const { return good; }
+
+private:
+    const int fd;
+    std::string buf;
+    bool good;
+};
@@ -0,0 +1,455 @@
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Intcode lifted to an intermediate representation, optimized one block at a time and run
+// by its own interpreter.
+//
+// A block is the code reachable from a (pc, relative base) pair without going through a
+// branch whose outcome depends on memory, an INPUT, or a SET_REL_OFFSET by a value read from
+// memory. Because the relative base is known when a block starts, every relative address in
+// it resolves to an absolute one: the optimizer sees exactly which cells each instruction
+// reads and writes, including through stack frames, with no aliasing to worry about.
+//
+// Self-modifying code: a block never runs past a store into code it lifted itself, and
+// after a block that stores into lifted code runs, every block lifted from the cells it
+// wrote is dropped. Lifting a cell that some cached block writes to drops that block first,
+// so no block ever runs with a stale view of the code.
+
+enum class IrOp {
+    ADD, MULT, LESS_THAN, EQUALS, MOVE, INPUT, OUTPUT,
+    JUMP_IF_TRUE, JUMP_IF_FALSE, JUMP, SET_REL_OFFSET, HALT, UNKNOWN,
+};
+
+// An immediate value, or the absolute address of a memory cell
+struct IrOperand {
+    bool immediate;
+    long long int value;
+
+    bool operator==(const IrOperand& other) const { return immediate == other.immediate && value == other.value; }
+};
+
+struct IrInstr {
+    IrOp op;
+    IrOperand a, b;
+
+    // Cell written by ADD to MOVE and by INPUT
+    size_t dst;
+
+    // Address of the Intcode instruction it comes from, and relative base when it runs
+    size_t pc;
+    long long int rb;
+};
+
+struct Block {
+    std::vector<IrInstr> code;
+
+    // Where execution continues if the last instruction doesn't jump
+    size_t end_pc;
+    long long int end_rb;
+
+    // Stores into lifted code: the blocks lifted from `stored_cells` are dropped after
+    // running this one
+    bool writes_code;
+
+    std::vector<size_t> code_cells;
+    std::vector<size_t> stored_cells;
+};
+
+struct OptimizerStats {
+    uint64_t blocks_built = 0;
+    uint64_t blocks_dropped = 0;
+    uint64_t folded = 0;
+    uint64_t branches_removed = 0;
+    uint64_t copies_propagated = 0;
+    uint64_t dead_stores = 0;
+};
+
+class Optimizer {
+public:
+    // With `optimize` false, blocks are lifted one Intcode instruction to one IR instruction,
+    // which is handy to check the lifting on its own
+    Optimizer(const Tape& tape, bool optimize = true): tape(tape), optimize(optimize) {}
+
+    const Block& block_at(size_t pc, long long int rb) {
+        auto key = std::make_pair(pc, rb);
+        auto it = blocks.find(key);
+        if (it != blocks.end()) return it->second;
+
+        auto block = build(pc, rb);
+        for (auto cell : block.code_cells) drop_users(stored_by, cell);
+
+        for (auto cell : block.code_cells) lifted_from[cell].push_back(key);
+        for (auto cell : block.stored_cells) stored_by[cell].push_back(key);
+        return blocks.emplace(key, std::move(block)).first->second;
+    }
+
+    // Drops every block lifted from one of `cells`, after they were written to
+    void code_written(const std::vector<size_t>& cells) {
+        for (auto cell : cells) drop_users(lifted_from, cell);
+    }
+
+    long long int& operator[](size_t addr) { return tape[addr]; }
+
+    const OptimizerStats& get_stats() const { return stats; }
+
+private:
+    struct PairHash {
+        size_t operator()(const std::pair<size_t,long long int>& key) const {
+            return std::hash<size_t>()(key.first) * 1000003 ^ std::hash<long long int>()(key.second);
+        }
+    };
+
+    Tape tape;
+    const bool optimize;
+    using key_t = std::pair<size_t,long long int>;
+    using users_t = std::unordered_map<size_t,std::vector<key_t>>;
+
+    std::unordered_map<key_t, Block, PairHash> blocks;
+
+    // Cached blocks by the cells they were lifted from, and by the cells they write to
+    users_t lifted_from;
+    users_t stored_by;
+
+    OptimizerStats stats;
+
+    // Longest run of Intcode instructions lifted into a single block
+    static const size_t max_block_length = 256;
+
+    void drop_users(users_t& users, size_t cell) {
+        auto it = users.find(cell);
+        if (it == users.end()) return;
+
+        auto keys = std::move(it->second);
+        users.erase(it);
+        for (const auto& key : keys) drop(key);
+    }
+
+    void drop(const key_t& key) {
+        auto it = blocks.find(key);
+        if (it == blocks.end()) return;
+
+        auto forget_key = [&key](users_t& users, size_t cell) {
+            auto users_it = users.find(cell);
+            if (users_it == users.end()) return;
+            auto& keys = users_it->second;
+            keys.erase(std::remove(keys.begin(), keys.end(), key), keys.end());
+            if (keys.empty()) users.erase(users_it);
+        };
+        for (auto cell : it->second.code_cells) forget_key(lifted_from, cell);
+        for (auto cell : it->second.stored_cells) forget_key(stored_by, cell);
+
+        blocks.erase(it);
+        stats.blocks_dropped++;
+    }
+
+    static bool is_pure(IrOp op) {
+        return op == IrOp::ADD || op == IrOp::MULT || op == IrOp::LESS_THAN || op == IrOp::EQUALS || op == IrOp::MOVE;
+    }
+
+    Block build(size_t pc, long long int rb) {
+        stats.blocks_built++;
+
+        Block block;
+        block.writes_code = false;
+
+        // What each cell written in this block is known to hold: a constant, or a copy of
+        // another cell that hasn't changed since
+        std::unordered_map<size_t,IrOperand> known;
+        std::unordered_set<size_t> block_code, block_stores, visited;
+
+        auto forget = [&known](size_t addr) {
+            known.erase(addr);
+            for (auto it = known.begin(); it != known.end(); ) {
+                if (!it->second.immediate && static_cast<size_t>(it->second.value) == addr) it = known.erase(it);
+                else it++;
+            }
+        };
+
+        auto resolve = [&](IrOperand op) {
+            if (!optimize || op.immediate) return op;
+            auto it = known.find(op.value);
+            if (it == known.end()) return op;
+            stats.copies_propagated++;
+            return it->second;
+        };
+
+        bool done = false;
+        size_t length = 0;
+        while (!done) {
+            // A store earlier in this block changed this instruction, or we're going around
+            // in a loop: continue in a new block
+            if (length == max_block_length || visited.count(pc) > 0 || block_stores.count(pc) > 0) break;
+
+            long long int word = tape[pc];
+            int opcode = word % 100;
+            int modes = word / 100;
+            size_t n_params = opcode == 1 || opcode == 2 || opcode == 7 || opcode == 8 ? 3
+                            : opcode == 5 || opcode == 6 ? 2
+                            : opcode == 3 || opcode == 4 || opcode == 9 ? 1 : 0;
+
+            bool params_changed = false;
+            for (size_t i = 1; i <= n_params; i++) params_changed = params_changed || block_stores.count(pc + i) > 0;
+            if (params_changed) break;
+
+            visited.insert(pc);
+            for (size_t i = 0; i <= n_params; i++) block_code.insert(pc + i);
+            length++;
+
+            auto param = [&](size_t i) {
+                int mode = (modes / (i == 1 ? 1 : i == 2 ? 10 : 100)) % 10;
+                long long int value = tape[pc + i];
+                if (mode == 1) return IrOperand{true, value};
+                return IrOperand{false, mode == 2 ? rb + value : value};
+            };
+            auto dst_param = [&](size_t i) {
+                auto op = param(i);
+                return op.immediate ? pc + i : static_cast<size_t>(op.value);
+            };
+
+            IrInstr instr{IrOp::UNKNOWN, {true, 0}, {true, 0}, 0, pc, rb};
+            size_t next_pc = pc + 1 + n_params;
+
+            switch (opcode) {
+                case 1: case 2: case 7: case 8: {
+                    instr.op = opcode == 1 ? IrOp::ADD : opcode == 2 ? IrOp::MULT : opcode == 7 ? IrOp::LESS_THAN : IrOp::EQUALS;
+                    instr.a = resolve(param(1));
+                    instr.b = resolve(param(2));
+                    instr.dst = dst_param(3);
+                    if (optimize) simplify(instr);
+                    break;
+                }
+                case 3: {
+                    instr.op = IrOp::INPUT;
+                    instr.dst = dst_param(1);
+                    done = true;
+                    break;
+                }
+                case 4: {
+                    instr.op = IrOp::OUTPUT;
+                    instr.a = resolve(param(1));
+                    break;
+                }
+                case 5: case 6: {
+                    instr.op = opcode == 5 ? IrOp::JUMP_IF_TRUE : IrOp::JUMP_IF_FALSE;
+                    instr.a = resolve(param(1));
+                    instr.b = resolve(param(2));
+                    if (optimize && instr.a.immediate) {
+                        stats.branches_removed++;
+                        bool taken = (instr.a.value != 0) == (opcode == 5);
+                        if (!taken) {
+                            pc = next_pc;
+                            continue;
+                        }
+                        if (instr.b.immediate) {
+                            pc = instr.b.value;
+                            continue;
+                        }
+                        instr.op = IrOp::JUMP;
+                        instr.a = instr.b;
+                    }
+                    done = true;
+                    break;
+                }
+                case 9: {
+                    instr.op = IrOp::SET_REL_OFFSET;
+                    instr.a = resolve(param(1));
+                    if (optimize && instr.a.immediate) {
+                        stats.folded++;
+                        rb += instr.a.value;
+                        pc = next_pc;
+                        continue;
+                    }
+                    done = true;
+                    break;
+                }
+                case 99: {
+                    instr.op = IrOp::HALT;
+                    done = true;
+                    break;
+                }
+                default: {
+                    done = true;
+                    break;
+                }
+            }
+
+            if (is_pure(instr.op) || instr.op == IrOp::INPUT) {
+                forget(instr.dst);
+                if (instr.op == IrOp::MOVE && instr.a == IrOperand{false, static_cast<long long int>(instr.dst)}) {
+                    // Copying a cell onto itself
+                    stats.folded++;
+                    pc = next_pc;
+                    continue;
+                }
+                if (optimize && instr.op == IrOp::MOVE) known[instr.dst] = instr.a;
+
+                block_stores.insert(instr.dst);
+                if (lifted_from.count(instr.dst) > 0 || block_code.count(instr.dst) > 0) {
+                    block.writes_code = true;
+                    done = true;
+                }
+            }
+
+            block.code.push_back(instr);
+            pc = next_pc;
+        }
+
+        block.end_pc = pc;
+        block.end_rb = rb;
+        if (optimize) remove_dead_stores(block);
+
+        block.code_cells.assign(block_code.begin(), block_code.end());
+        block.stored_cells.assign(block_stores.begin(), block_stores.end());
+        return block;
+    }
+
+    // Folds arithmetic on immediates, and turns the identities (x + 0, x * 1, x * 0) into
+    // moves
+    void simplify(IrInstr& instr) {
+        auto& a = instr.a;
+        auto& b = instr.b;
+        if (a.immediate && b.immediate) {
+            long long int v = 0;
+            switch (instr.op) {
+                case IrOp::ADD:       v = a.value + b.value; break;
+                case IrOp::MULT:      v = a.value * b.value; break;
+                case IrOp::LESS_THAN: v = a.value < b.value ? 1 : 0; break;
+                case IrOp::EQUALS:    v = a.value == b.value ? 1 : 0; break;
+                default: return;
+            }
+            instr = {IrOp::MOVE, {true, v}, {true, 0}, instr.dst, instr.pc, instr.rb};
+            stats.folded++;
+            return;
+        }
+
+        auto move = [&instr, this](IrOperand src) {
+            instr = {IrOp::MOVE, src, {true, 0}, instr.dst, instr.pc, instr.rb};
+            stats.folded++;
+        };
+        if (instr.op == IrOp::ADD && a == IrOperand{true, 0}) move(b);
+        else if (instr.op == IrOp::ADD && b == IrOperand{true, 0}) move(a);
+        else if (instr.op == IrOp::MULT && a == IrOperand{true, 1}) move(b);
+        else if (instr.op == IrOp::MULT && b == IrOperand{true, 1}) move(a);
+        else if (instr.op == IrOp::MULT && (a == IrOperand{true, 0} || b == IrOperand{true, 0})) move({true, 0});
+    }
+
+    // Drops stores that are overwritten later in the block before anything reads them.
+    // Blocks only exit at their last instruction (or before an INPUT, which is always last),
+    // so every other store is still visible when the block ends
+    void remove_dead_stores(Block& block) {
+        std::unordered_set<size_t> overwritten;
+        std::vector<IrInstr> kept;
+        for (auto it = block.code.rbegin(); it != block.code.rend(); it++) {
+            if (is_pure(it->op) && overwritten.count(it->dst) > 0) {
+                stats.dead_stores++;
+                continue;
+            }
+            if (is_pure(it->op) || it->op == IrOp::INPUT) overwritten.insert(it->dst);
+            if (!it->a.immediate) overwritten.erase(it->a.value);
+            if (!it->b.immediate) overwritten.erase(it->b.value);
+            kept.push_back(*it);
+        }
+        block.code.assign(kept.rbegin(), kept.rend());
+    }
+};
+
+// Runs a program through `Optimizer` blocks, with the same queue based I/O as `CPU`
+class IrCPU {
+public:
+    IrCPU(const Tape& tape, bool optimize = true):
+        memory(tape, optimize), pc(0), rb(0), instructions_executed(0) {}
+
+    InstrExecStatus run_until_more_input_is_required() {
+        while (true) {
+            const Block& block = memory.block_at(pc, rb);
+            auto status = run_block(block);
+            if (block.writes_code) {
+                auto cells = block.stored_cells;
+                memory.code_written(cells);
+            }
+            if (status != InstrExecStatus::ALL_GOOD) return status;
+        }
+    }
+
+    std::queue<long long int>& get_in() { return in; }
+    std::queue<long long int>& get_out() { return out; }
+
+    // IR instructions executed so far
+    uint64_t get_instructions_executed() const { return instructions_executed; }
+    const OptimizerStats& get_stats() const { return memory.get_stats(); }
+
+private:
+    Optimizer memory;
+    size_t pc;
+    long long int rb;
+    uint64_t instructions_executed;
+
+    std::queue<long long int> in;
+    std::queue<long long int> out;
+
+    long long int value(const IrOperand& op) {
+        return op.immediate ? op.value : memory[op.value];
+    }
+
+    InstrExecStatus run_block(const Block& block) {
+        for (const auto& instr : block.code) {
+            if (instr.op == IrOp::INPUT && in.empty()) {
+                pc = instr.pc;
+                rb = instr.rb;
+                return InstrExecStatus::NO_INPUT;
+            }
+            instructions_executed++;
+
+            switch (instr.op) {
+                case IrOp::ADD:       memory[instr.dst] = value(instr.a) + value(instr.b); break;
+                case IrOp::MULT:      memory[instr.dst] = value(instr.a) * value(instr.b); break;
+                case IrOp::LESS_THAN: memory[instr.dst] = value(instr.a) < value(instr.b) ? 1 : 0; break;
+                case IrOp::EQUALS:    memory[instr.dst] = value(instr.a) == value(instr.b) ? 1 : 0; break;
+                case IrOp::MOVE:      memory[instr.dst] = value(instr.a); break;
+                case IrOp::INPUT: {
+                    memory[instr.dst] = in.front();
+                    in.pop();
+                    break;
+                }
+                case IrOp::OUTPUT: out.push(value(instr.a)); break;
+                case IrOp::JUMP_IF_TRUE:
+                case IrOp::JUMP_IF_FALSE: {
+                    if ((value(instr.a) != 0) == (instr.op == IrOp::JUMP_IF_TRUE)) {
+                        pc = value(instr.b);
+                        rb = instr.rb;
+                        return InstrExecStatus::ALL_GOOD;
+                    }
+                    break;
+                }
+                case IrOp::JUMP: {
+                    pc = value(instr.a);
+                    rb = instr.rb;
+                    return InstrExecStatus::ALL_GOOD;
+                }
+                case IrOp::SET_REL_OFFSET: {
+                    pc = block.end_pc;
+                    rb = instr.rb + value(instr.a);
+                    return InstrExecStatus::ALL_GOOD;
+                }
+                case IrOp::HALT: {
+                    pc = instr.pc;
+                    rb = instr.rb;
+                    return InstrExecStatus::HALT;
+                }
+                case IrOp::UNKNOWN: {
+                    pc = instr.pc;
+                    rb = instr.rb;
+                    return InstrExecStatus::UNKOWN_OPCODE;
+                }
+            }
+        }
+        pc = block.end_pc;
+        rb = block.end_rb;
+        return InstrExecStatus::ALL_GOOD;
+    }
+};
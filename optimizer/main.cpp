@@ -0,0 +1,119 @@
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../intcode/cpu.hpp"
+#include "ir.hpp"
+
+struct Workload {
+    std::string name;
+    Tape tape;
+    std::vector<long long int> input;
+};
+
+std::vector<long long int> ascii(const std::vector<std::string>& lines) {
+    std::vector<long long int> values;
+    for (const auto& line : lines) {
+        for (auto c : line) values.push_back(c);
+        values.push_back('\n');
+    }
+    return values;
+}
+
+Tape make_tape(const std::vector<long long int>& code) {
+    Tape tape;
+    for (size_t i = 0; i < code.size(); i++) tape[i] = code[i];
+    return tape;
+}
+
+template <typename Machine>
+std::vector<long long int> run(Machine& machine, const std::vector<long long int>& input) {
+    for (auto v : input) machine.get_in().push(v);
+    machine.run_until_more_input_is_required();
+
+    std::vector<long long int> output;
+    auto& out = machine.get_out();
+    for (; !out.empty(); out.pop()) output.push_back(out.front());
+    return output;
+}
+
+// Runs `workload` on the plain interpreter, on blocks lifted as they are, and on optimized
+// blocks. All three must produce the same output
+bool compare(const Workload& workload) {
+    CPU reference(workload.tape);
+    IrCPU lifted(workload.tape, false);
+    IrCPU optimized(workload.tape, true);
+
+    auto expected = run(reference, workload.input);
+    bool same = run(lifted, workload.input) == expected && run(optimized, workload.input) == expected;
+
+    auto before = reference.get_instructions_executed();
+    auto after = optimized.get_instructions_executed();
+    const auto& stats = optimized.get_stats();
+
+    std::cout << std::left << std::setw(15) << workload.name << std::right
+              << std::setw(12) << before
+              << std::setw(12) << lifted.get_instructions_executed()
+              << std::setw(12) << after
+              << std::setw(8) << std::fixed << std::setprecision(1) << 100.0 * (before - after) / before << "%"
+              << std::setw(8) << stats.blocks_built
+              << std::setw(8) << stats.blocks_dropped
+              << std::setw(8) << stats.folded
+              << std::setw(10) << stats.branches_removed
+              << std::setw(10) << stats.copies_propagated
+              << std::setw(8) << stats.dead_stores
+              << (same ? "" : "  OUTPUT DIFFERS") << std::endl;
+    return same;
+}
+
+int main() {
+    const auto boost = read_tape_from_disk("../day9/input.txt");
+    const auto springdroid = read_tape_from_disk("../day21/input.txt");
+    const auto adventure = read_tape_from_disk("../day25/input.txt");
+
+    const std::vector<Workload> workloads{
+        {"day9-test", boost, {1}},
+        {"day9-boost", boost, {2}},
+        {"day21-run", springdroid, ascii({
+            "NOT C J", "NOT B T", "OR T J", "NOT A T", "OR T J", "AND D J",
+            "NOT E T", "NOT T T", "OR H T", "AND T J", "RUN",
+        })},
+        {"day25-checkpt", adventure, ascii({
+            "east", "north", "north", "take planetoid", "east", "take cake", "south", "west",
+            "north", "take astrolabe", "west", "south", "south", "north", "north", "east",
+            "north", "east",
+        })},
+
+        // Writes the operand of an instruction it's about to run
+        //   0: ADD #7 #8 $9
+        //   4: JIT #1 #8
+        //   8: OUT #0
+        //  10: HLT
+        {"selfmod-patch", make_tape({1101, 7, 8, 9, 1105, 1, 8, 0, 104, 0, 99}), {}},
+
+        // Counts in the immediate operand of its own OUT instruction
+        //   0: OUT #0
+        //   2: ADD $1 #1 $1
+        //   6: LT $1 #5 $20
+        //  10: JIT $20 #0
+        //  13: HLT
+        {"selfmod-loop", make_tape({104, 0, 1001, 1, 1, 1, 1007, 1, 5, 20, 1005, 20, 0, 99}), {}},
+    };
+
+    std::cout << std::left << std::setw(15) << "workload" << std::right
+              << std::setw(12) << "intcode"
+              << std::setw(12) << "lifted"
+              << std::setw(12) << "optimized"
+              << std::setw(9) << "saved"
+              << std::setw(8) << "blocks"
+              << std::setw(8) << "dropped"
+              << std::setw(8) << "folded"
+              << std::setw(10) << "branches"
+              << std::setw(10) << "copies"
+              << std::setw(8) << "dead" << std::endl;
+
+    bool ok = true;
+    for (const auto& workload : workloads) ok = compare(workload) && ok;
+    return ok ? 0 : 1;
+}
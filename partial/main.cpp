@@ -0,0 +1,162 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../intcode/cpu.hpp"
+#include "residual.hpp"
+
+using input_t = std::vector<long long int>;
+
+// Jobs that all start with one of a few known prefixes
+struct Workload {
+    std::string name;
+    Tape tape;
+    std::vector<input_t> prefixes;
+
+    // Index of the prefix each job starts with, and the rest of its input
+    std::vector<std::pair<size_t,input_t>> jobs;
+};
+
+input_t ascii(const std::string& text) {
+    return input_t(text.begin(), text.end());
+}
+
+input_t run_job(CPU cpu, const input_t& input, uint64_t& instructions) {
+    for (auto v : input) cpu.get_in().push(v);
+    cpu.run_until_more_input_is_required();
+    instructions += cpu.get_instructions_executed();
+
+    input_t output;
+    for (auto& out = cpu.get_out(); !out.empty(); out.pop()) output.push_back(out.front());
+    return output;
+}
+
+// Runs every job from the original program with its whole input, then from the residual of
+// its prefix with the rest of the input. Both must produce the same outputs
+bool compare(const Workload& workload) {
+    using clock = std::chrono::steady_clock;
+
+    std::vector<input_t> expected;
+    uint64_t before = 0;
+    auto start = clock::now();
+    for (const auto& job : workload.jobs) {
+        auto input = workload.prefixes[job.first];
+        input.insert(input.end(), job.second.begin(), job.second.end());
+        expected.push_back(run_job(CPU(workload.tape), input, before));
+    }
+    auto from_scratch = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+
+    start = clock::now();
+    std::vector<Residual> residuals;
+    for (const auto& prefix : workload.prefixes) residuals.push_back(specialize(workload.tape, prefix));
+    auto specializing = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+
+    bool same = true;
+    uint64_t after = 0;
+    start = clock::now();
+    for (size_t i = 0; i < workload.jobs.size(); i++) {
+        const auto& job = workload.jobs[i];
+        same = run_job(resume(residuals[job.first]), job.second, after) == expected[i] && same;
+    }
+    auto from_residual = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+
+    auto n = workload.jobs.size();
+    std::cout << std::left << std::setw(14) << workload.name << std::right
+              << std::setw(7) << n
+              << std::setw(11) << workload.prefixes.size()
+              << std::setw(12) << before / n
+              << std::setw(12) << after / n
+              << std::setw(8) << std::fixed << std::setprecision(1) << 100.0 * (before - after) / before << "%"
+              << std::setw(11) << from_scratch / n << "us"
+              << std::setw(10) << from_residual / n << "us"
+              << std::setw(12) << specializing << "us"
+              << (same ? "" : "  OUTPUT DIFFERS") << std::endl;
+    return same;
+}
+
+// Each argument is one input value, or a line of ASCII text if it isn't a number
+input_t parse_inputs(char** begin, char** end) {
+    input_t input;
+    for (auto arg = begin; arg != end; arg++) {
+        std::string s(*arg);
+        try {
+            size_t used;
+            auto v = std::stoll(s, &used);
+            if (used == s.size()) {
+                input.push_back(v);
+                continue;
+            }
+        } catch (const std::exception&) {}
+        auto text = ascii(s + "\n");
+        input.insert(input.end(), text.begin(), text.end());
+    }
+    return input;
+}
+
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "";
+
+    // A residual file that can't be written or read is reported, with exit code 1
+    try {
+        if (mode == "--emit" && argc > 3) {
+            auto residual = specialize(read_tape_from_disk(argv[2]), parse_inputs(argv + 4, argv + argc));
+            write_residual(residual, argv[3]);
+            std::cout << "Skipped " << residual.instructions_saved << " instructions, resuming at pc "
+                      << residual.pc << std::endl;
+            return 0;
+        }
+
+        if (mode == "--run" && argc > 2) {
+            uint64_t instructions = 0;
+            for (auto v : run_job(resume(read_residual(argv[2])), parse_inputs(argv + 3, argv + argc), instructions)) {
+                std::cout << v << std::endl;
+            }
+            return 0;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (!mode.empty()) {
+        std::cerr << "usage: " << argv[0] << " [--emit <program> <residual> [prefix...] | --run <residual> [inputs...]]" << std::endl;
+        return 1;
+    }
+
+    // Day 7: the phase setting, then any input signal
+    Workload amplifiers{"day7-phase", read_tape_from_disk("../day7/input.txt"), {}, {}};
+    for (long long int phase = 0; phase < 10; phase++) amplifiers.prefixes.push_back({phase});
+    for (size_t phase = 0; phase < 10; phase++) {
+        for (long long int signal = 0; signal < 100; signal++) amplifiers.jobs.push_back({phase, {signal}});
+    }
+
+    // Day 23: the network address, then polls with no packet
+    Workload network{"day23-address", read_tape_from_disk("../day23/input.txt"), {}, {}};
+    for (size_t address = 0; address < 50; address++) {
+        network.prefixes.push_back({static_cast<long long int>(address)});
+        network.jobs.push_back({address, {-1}});
+        network.jobs.push_back({address, {-1, -1}});
+    }
+
+    // Day 21: a springscript, then the command that runs it
+    Workload springdroid{"day21-script", read_tape_from_disk("../day21/input.txt"), {
+        ascii("NOT A J\nNOT C T\nOR T J\nAND D J\n"),
+    }, {}};
+    for (int i = 0; i < 20; i++) springdroid.jobs.push_back({0, ascii("WALK\n")});
+
+    std::cout << std::left << std::setw(14) << "workload" << std::right
+              << std::setw(7) << "jobs"
+              << std::setw(11) << "residuals"
+              << std::setw(12) << "instr/job"
+              << std::setw(12) << "residual"
+              << std::setw(9) << "saved"
+              << std::setw(13) << "time/job"
+              << std::setw(12) << "residual"
+              << std::setw(14) << "specialize" << std::endl;
+
+    bool ok = true;
+    for (const auto& workload : {amplifiers, network, springdroid}) ok = compare(workload) && ok;
+    return ok ? 0 : 1;
+}
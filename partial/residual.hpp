@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Snapshots of an Intcode program taken after the first inputs of its jobs, when those are
+// the same every time (an address, a phase setting, a script). Nothing the program does
+// before asking for its first unknown input depends on anything but the known prefix, so it
+// only has to run that far once. The residual is the machine at that point: memory, pc,
+// relative base and the outputs produced so far. Jobs started from it skip the prefix work.
+//
+// This is a checkpoint, not a specializer: the code the program runs after the prefix is
+// kept as it is, with nothing folded or removed, so a job from a residual runs exactly the
+// instructions that follow the prefix in a job from scratch.
+
+struct Residual {
+    Image memory;
+    size_t pc;
+    size_t relative_addr_base;
+
+    // Produced while reading the prefix, every job from this residual starts with them
+    std::vector<long long int> outputs;
+
+    // Instructions that every job started from this residual doesn't have to run
+    uint64_t instructions_saved;
+};
+
+void trim_zeros(Image& memory) {
+    while (!memory.empty() && memory.back() == 0) memory.pop_back();
+}
+
+Residual specialize(const Tape& tape, const std::vector<long long int>& prefix) {
+    CPU cpu(tape);
+    for (auto v : prefix) cpu.get_in().push(v);
+    cpu.run_until_more_input_is_required();
+
+    Residual residual;
+
+    // Cells that hold zero are the same as cells past the end of memory, and copying less
+    // memory makes every job cheaper to start
+    residual.memory = cpu.get_memory();
+    trim_zeros(residual.memory);
+    residual.pc = cpu.get_pc();
+    residual.relative_addr_base = cpu.get_relative_addr_base();
+    for (auto& out = cpu.get_out(); !out.empty(); out.pop()) residual.outputs.push_back(out.front());
+    residual.instructions_saved = cpu.get_instructions_executed();
+    return residual;
+}
+
+// A CPU ready to run a job from `residual`, with the prefix outputs already in its output
+CPU resume(const Residual& residual) {
+    CPU cpu(residual.memory, residual.pc, residual.relative_addr_base);
+    for (auto v : residual.outputs) cpu.get_out().push(v);
+    return cpu;
+}
+
+// Three lines: "pc relative-base", the prefix outputs separated by spaces, and the memory as
+// a regular comma separated program
+void write_residual(const Residual& residual, const std::string& filename) {
+    std::ofstream file(filename);
+    if (!file) throw std::runtime_error("Could not open " + filename);
+
+    file << residual.pc << " " << residual.relative_addr_base << std::endl;
+    for (size_t i = 0; i < residual.outputs.size(); i++) file << (i > 0 ? " " : "") << residual.outputs[i];
+    file << std::endl;
+
+    for (size_t addr = 0; addr < residual.memory.size(); addr++) {
+        file << (addr > 0 ? "," : "") << residual.memory[addr];
+    }
+    file << std::endl;
+    if (!file) throw std::runtime_error("Could not write " + filename);
+}
+
+Residual read_residual(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file) throw std::runtime_error("Could not open " + filename);
+
+    Residual residual;
+    residual.instructions_saved = 0;
+
+    std::string line, rest;
+    std::getline(file, line);
+    std::istringstream header(line);
+    if (!(header >> residual.pc >> residual.relative_addr_base) || header >> rest) {
+        throw std::runtime_error(filename + ": expected \"pc relative-base\" on the first line");
+    }
+
+    if (!std::getline(file, line)) throw std::runtime_error(filename + ": missing the outputs line");
+    std::istringstream outputs(line);
+    for (long long int v; outputs >> v; ) residual.outputs.push_back(v);
+    if (!outputs.eof()) throw std::runtime_error(filename + ": outputs must be integers");
+
+    residual.memory = read_image(file);
+    trim_zeros(residual.memory);
+    return residual;
+}